@@ -0,0 +1,254 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <immintrin.h>
+#include <limits>
+#include <vector>
+
+namespace conv {
+
+namespace {
+// outputs per channel transposed at a time, so that the interleaved input and output stay in L1/L2
+constexpr size_t chunkLen = 512;
+constexpr size_t blockRows = 2;
+// Where transposing beats separate convolve() calls on the instruction set those use, measured with simd-bench
+// --kernels batch-transposed,batch-separate: for a few new samples per channel and, with AVX2, for long filters.
+struct Crossover {
+    size_t maxSamples;
+    size_t minHLen;
+};
+
+Crossover crossover() {
+    if (cpu::detect() == cpu::Isa::avx512bw) {
+        return {8, std::numeric_limits<size_t>::max()};
+    }
+    return {8, 32};
+}
+
+bool transposedFaster(const int16_t* h, size_t hLen, size_t yLen) {
+    if (not cpu::supports(cpu::Isa::avx2) or symmetry(h, hLen) != Symmetry::none) {
+        return false;
+    }
+    const Crossover limits = crossover();
+    // yLen - (hLen - 1) new samples per channel
+    return yLen <= hLen - 1 + limits.maxSamples or hLen >= limits.minHLen;
+}
+
+size_t roundUp(size_t len) {
+    return (len + batchChannels - 1) / batchChannels * batchChannels;
+}
+
+// 16 x 16 transpose of 16 bit elements: rows[r][k] -> rows[k][r]
+TARGET_AVX2 void transpose(__m256i rows[16]) {
+    // pairs of rows in 32 bit elements: (rows[2i][k], rows[2i + 1][k])
+    __m256i pairs[16];
+    for (size_t i = 0; i < 8; ++i) {
+        pairs[2 * i] = _mm256_unpacklo_epi16(rows[2 * i], rows[2 * i + 1]);
+        pairs[2 * i + 1] = _mm256_unpackhi_epi16(rows[2 * i], rows[2 * i + 1]);
+    }
+    // quads of rows in 64 bit elements
+    __m256i quads[16];
+    for (size_t g = 0; g < 4; ++g) {
+        quads[4 * g] = _mm256_unpacklo_epi32(pairs[4 * g], pairs[4 * g + 2]);
+        quads[4 * g + 1] = _mm256_unpackhi_epi32(pairs[4 * g], pairs[4 * g + 2]);
+        quads[4 * g + 2] = _mm256_unpacklo_epi32(pairs[4 * g + 1], pairs[4 * g + 3]);
+        quads[4 * g + 3] = _mm256_unpackhi_epi32(pairs[4 * g + 1], pairs[4 * g + 3]);
+    }
+    // octets[8h + k] has rows 8h..8h+7 of column k in the low lane and of column k + 8 in the high lane
+    __m256i octets[16];
+    for (size_t h = 0; h < 2; ++h) {
+        for (size_t m = 0; m < 4; ++m) {
+            octets[8 * h + 2 * m] = _mm256_unpacklo_epi64(quads[8 * h + m], quads[8 * h + 4 + m]);
+            octets[8 * h + 2 * m + 1] = _mm256_unpackhi_epi64(quads[8 * h + m], quads[8 * h + 4 + m]);
+        }
+    }
+    for (size_t k = 0; k < 8; ++k) {
+        rows[k] = _mm256_permute2x128_si256(octets[k], octets[8 + k], 0x20);
+        rows[k + 8] = _mm256_permute2x128_si256(octets[k], octets[8 + k], 0x31);
+    }
+}
+
+TARGET_AVX2 void interleaveAvx2(const int16_t* const* x, size_t channelCount, size_t len, int16_t* interleaved) {
+    size_t t = 0;
+    for (; t + batchChannels <= len; t += batchChannels) {
+        __m256i rows[batchChannels];
+        for (size_t c = 0; c < batchChannels; ++c) {
+            rows[c] = c < channelCount ? _mm256_loadu_si256((const __m256i*)&x[c][t]) : _mm256_setzero_si256();
+        }
+        transpose(rows);
+        for (size_t k = 0; k < batchChannels; ++k) {
+            _mm256_storeu_si256((__m256i*)&interleaved[(t + k) * batchChannels], rows[k]);
+        }
+    }
+    for (; t < len; ++t) {
+        for (size_t c = 0; c < batchChannels; ++c) {
+            interleaved[t * batchChannels + c] = c < channelCount ? x[c][t] : 0;
+        }
+    }
+}
+
+TARGET_AVX2 void deinterleaveAvx2(const int16_t* interleaved, size_t len, int16_t* const* y, size_t channelCount) {
+    size_t t = 0;
+    for (; t + batchChannels <= len; t += batchChannels) {
+        __m256i rows[batchChannels];
+        for (size_t k = 0; k < batchChannels; ++k) {
+            rows[k] = _mm256_loadu_si256((const __m256i*)&interleaved[(t + k) * batchChannels]);
+        }
+        transpose(rows);
+        for (size_t c = 0; c < channelCount; ++c) {
+            _mm256_storeu_si256((__m256i*)&y[c][t], rows[c]);
+        }
+    }
+    for (; t < len; ++t) {
+        for (size_t c = 0; c < channelCount; ++c) {
+            y[c][t] = interleaved[t * batchChannels + c];
+        }
+    }
+}
+
+// same as smartAvx2, but with the rows of two time indices at a time, so that each weight held in a register (or
+// spilled, for long filters) is used for two multiplies; more rows per block were slower
+template<size_t HLen>
+TARGET_AVX2 int16_t* interleavedAvx2(const int16_t* x, const int16_t* h, int16_t* y, size_t yLen) {
+    __m256i mFilter[HLen];
+    for (size_t i = 0; i < HLen; ++i) {
+        mFilter[i] = _mm256_set1_epi16(h[(HLen - 1) - i]);
+    }
+    size_t t = 0;
+    for (; t + blockRows <= yLen; t += blockRows) {
+        __m256i sum[blockRows];
+        for (size_t j = 0; j < blockRows; ++j) {
+            sum[j] = _mm256_mullo_epi16(_mm256_loadu_si256((const __m256i*)&x[(t + j) * batchChannels]), mFilter[0]);
+        }
+        for (size_t i = 1; i < HLen; ++i) {
+            for (size_t j = 0; j < blockRows; ++j) {
+                __m256i input = _mm256_loadu_si256((const __m256i*)&x[(t + j + i) * batchChannels]);
+                sum[j] = _mm256_add_epi16(sum[j], _mm256_mullo_epi16(input, mFilter[i]));
+            }
+        }
+        for (size_t j = 0; j < blockRows; ++j) {
+            _mm256_storeu_si256((__m256i*)&y[(t + j) * batchChannels], sum[j]);
+        }
+    }
+    for (; t < yLen; ++t) {
+        __m256i sum = _mm256_mullo_epi16(_mm256_loadu_si256((const __m256i*)&x[t * batchChannels]), mFilter[0]);
+        for (size_t i = 1; i < HLen; ++i) {
+            __m256i input = _mm256_loadu_si256((const __m256i*)&x[(t + i) * batchChannels]);
+            sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(input, mFilter[i]));
+        }
+        _mm256_storeu_si256((__m256i*)&y[t * batchChannels], sum);
+    }
+    return y;
+}
+
+// fallback for filter lengths without a specialization: each weight is broadcast once per block of rows
+TARGET_AVX2 int16_t* blockedInterleavedAvx2(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    size_t t = 0;
+    for (; t + blockRows <= yLen; t += blockRows) {
+        __m256i sum[blockRows];
+        for (size_t j = 0; j < blockRows; ++j) {
+            sum[j] = _mm256_setzero_si256();
+        }
+        for (size_t i = 0; i < hLen; ++i) {
+            const __m256i weight = _mm256_set1_epi16(h[(hLen - 1) - i]);
+            for (size_t j = 0; j < blockRows; ++j) {
+                __m256i input = _mm256_loadu_si256((const __m256i*)&x[(t + j + i) * batchChannels]);
+                sum[j] = _mm256_add_epi16(sum[j], _mm256_mullo_epi16(input, weight));
+            }
+        }
+        for (size_t j = 0; j < blockRows; ++j) {
+            _mm256_storeu_si256((__m256i*)&y[(t + j) * batchChannels], sum[j]);
+        }
+    }
+    for (; t < yLen; ++t) {
+        __m256i sum = _mm256_setzero_si256();
+        for (size_t i = 0; i < hLen; ++i) {
+            __m256i input = _mm256_loadu_si256((const __m256i*)&x[(t + i) * batchChannels]);
+            sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(input, _mm256_set1_epi16(h[(hLen - 1) - i])));
+        }
+        _mm256_storeu_si256((__m256i*)&y[t * batchChannels], sum);
+    }
+    return y;
+}
+
+// the channel loop is contiguous, so the compiler can still vectorize it for the baseline
+int16_t* convolveInterleavedGeneric(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    for (size_t t = 0; t < yLen; ++t) {
+        int16_t sum[batchChannels]{};
+        for (size_t i = 0; i < hLen; ++i) {
+            for (size_t c = 0; c < batchChannels; ++c) {
+                sum[c] += h[i] * x[((hLen - 1) - i + t) * batchChannels + c];
+            }
+        }
+        std::copy(sum, sum + batchChannels, &y[t * batchChannels]);
+    }
+    return y;
+}
+}
+
+void interleave(const int16_t* const* x, size_t channelCount, size_t len, int16_t* interleaved) {
+    if (cpu::supports(cpu::Isa::avx2)) {
+        interleaveAvx2(x, channelCount, len, interleaved);
+        return;
+    }
+    for (size_t t = 0; t < len; ++t) {
+        for (size_t c = 0; c < batchChannels; ++c) {
+            interleaved[t * batchChannels + c] = c < channelCount ? x[c][t] : 0;
+        }
+    }
+}
+
+void deinterleave(const int16_t* interleaved, size_t len, int16_t* const* y, size_t channelCount) {
+    if (cpu::supports(cpu::Isa::avx2)) {
+        deinterleaveAvx2(interleaved, len, y, channelCount);
+        return;
+    }
+    for (size_t t = 0; t < len; ++t) {
+        for (size_t c = 0; c < channelCount; ++c) {
+            y[c][t] = interleaved[t * batchChannels + c];
+        }
+    }
+}
+
+int16_t* convolveInterleaved(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    if (not cpu::supports(cpu::Isa::avx2)) {
+        return convolveInterleavedGeneric(x, h, hLen, y, yLen);
+    }
+    return dispatchLength(hLen, [&](auto length) { return interleavedAvx2<decltype(length)::value>(x, h, y, yLen); },
+        [&] { return blockedInterleavedAvx2(x, h, hLen, y, yLen); });
+}
+
+void convolveTransposed(const int16_t* const* x, size_t channelCount, const int16_t* h, size_t hLen, int16_t* const* y, size_t yLen) {
+    // the padding of the channels lets the transposes round every chunk up to whole 16 x 16 blocks
+    const size_t overlap = hLen - 1;
+    const size_t maxChunkLen = std::min(chunkLen, roundUp(yLen));
+    std::vector<int16_t> input(roundUp(overlap + maxChunkLen) * batchChannels);
+    std::vector<int16_t> output(maxChunkLen * batchChannels);
+    const int16_t* groupX[batchChannels];
+    int16_t* groupY[batchChannels];
+    for (size_t first = 0; first < channelCount; first += batchChannels) {
+        const size_t groupChannels = std::min(batchChannels, channelCount - first);
+        for (size_t t = 0; t < yLen; t += chunkLen) {
+            // every chunk brings its own hLen - 1 sample halo along
+            const size_t len = std::min(chunkLen, yLen - t);
+            for (size_t c = 0; c < groupChannels; ++c) {
+                groupX[c] = &x[first + c][t];
+                groupY[c] = &y[first + c][t];
+            }
+            interleave(groupX, groupChannels, roundUp(overlap + len), input.data());
+            // only len rows are needed; the rest of the last block lands in the output padding
+            convolveInterleaved(input.data(), h, hLen, output.data(), len);
+            deinterleave(output.data(), roundUp(len), groupY, groupChannels);
+        }
+    }
+}
+
+void convolveBatch(const int16_t* const* x, size_t channelCount, const int16_t* h, size_t hLen, int16_t* const* y, size_t yLen) {
+    if (not transposedFaster(h, hLen, yLen)) {
+        for (size_t c = 0; c < channelCount; ++c) {
+            convolve(x[c], h, hLen, y[c], yLen);
+        }
+        return;
+    }
+    convolveTransposed(x, channelCount, h, hLen, y, yLen);
+}
+}
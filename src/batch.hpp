@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "convolution.hpp"
+#include "cpu.hpp"
+
+// Convolution of many channels with the same filter. The channels are processed in groups of batchChannels in a
+// channel-interleaved layout (x[t * batchChannels + c]), so that one AVX2 register holds the same time index of the
+// whole group. Short channels then fill the registers as well as long ones, and the filter is broadcast once per
+// group instead of once per channel. Data that arrives interleaved can be convolved as it is; separate channels are
+// transposed in and out when the channels are short or the filter long enough for that to pay off.
+namespace conv {
+
+constexpr size_t batchChannels = 16;
+
+// padding of each channel for convolveBatch(): the transposes work on whole 16 x 16 blocks
+constexpr Padding batchPadding(size_t hLen) {
+    return padding(batchChannels, hLen);
+}
+
+// Transposes channelCount <= batchChannels channels of len samples into the interleaved layout; the missing channels
+// are filled with zeros.
+void interleave(const int16_t* const* x, size_t channelCount, size_t len, int16_t* interleaved);
+// and back
+void deinterleave(const int16_t* interleaved, size_t len, int16_t* const* y, size_t channelCount);
+
+// conv::convolve() of an interleaved group: reads the rows [0, yLen + hLen - 1), of which the first hLen - 1 have to
+// be zeros, and writes exactly yLen rows.
+int16_t* convolveInterleaved(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen);
+
+// Convolves channelCount separate channels by transposing them in and out of groups in chunks. Each x[c] and y[c]
+// needs batchPadding().
+void convolveTransposed(const int16_t* const* x, size_t channelCount, const int16_t* h, size_t hLen, int16_t* const* y, size_t yLen);
+
+// Convolves channelCount separate channels with convolveTransposed() or with separate convolve() calls, whichever is
+// faster for the filter and the channel length. Each x[c] and y[c] needs batchPadding().
+void convolveBatch(const int16_t* const* x, size_t channelCount, const int16_t* h, size_t hLen, int16_t* const* y, size_t yLen);
+}
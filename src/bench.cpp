@@ -0,0 +1,619 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "batch.hpp"
+#include "convolution.hpp"
+#include "cpu.hpp"
+#include "fft.hpp"
+#include "perf.hpp"
+#include "plane.hpp"
+#include "resample.hpp"
+
+// Benchmark sweep over kernel x input length x filter length, with channel count (batch) or factor (resampling) as a
+// further axis for the other modes, and over plane size x kernel size for 2D. Prints JSON, which --compare checks
+// against a saved baseline.
+
+namespace {
+
+struct Kernel {
+    std::string name;
+    cpu::Isa isa;
+    std::function<int16_t*(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen)> convolve;
+};
+
+struct PlaneSize {
+    size_t width;
+    size_t height;
+};
+
+struct Options {
+    std::vector<std::string> kernels;
+    // from L1-resident (2 * 1K samples) to DRAM-sized (2 * 4M samples)
+    std::vector<size_t> lengths{1 << 10, 1 << 14, 1 << 18, 1 << 22};
+    std::vector<size_t> taps{5, 31, 63, 512};
+    // random filters are asymmetric; convolve() folds symmetric and antisymmetric ones
+    std::vector<conv::Symmetry> symmetries{conv::Symmetry::none};
+    std::vector<size_t> channelCounts{256};
+    std::vector<size_t> factors{2, 4};
+    std::vector<PlaneSize> planes{{1920, 1080}};
+    std::vector<size_t> kernelSizes{3, 5, 7};
+    std::chrono::milliseconds budget{200};
+    size_t minSamples = 5;
+    size_t maxSamples = 101;
+};
+
+struct Result {
+    std::string kernel;
+    conv::Symmetry symmetry;
+    std::string shape;            // empty for single 1D convolutions
+    size_t xLen;                  // width * height for planes
+    size_t hLen;                  // kernel width and height for planes
+    size_t samples;
+    double medianCyclesPerOutput; // TSC cycles
+    double p99CyclesPerOutput;
+    double gbPerSecond;           // input and output bytes
+    bool hasCounter[perf::counterCount];
+    double counterPerOutput[perf::counterCount];
+};
+
+const char* name(conv::Symmetry symmetry) {
+    switch (symmetry) {
+        case conv::Symmetry::none: return "none";
+        case conv::Symmetry::symmetric: return "symmetric";
+        case conv::Symmetry::antisymmetric: return "antisymmetric";
+    }
+    return "";
+}
+
+conv::Symmetry parseSymmetry(const std::string& value) {
+    for (conv::Symmetry symmetry : {conv::Symmetry::none, conv::Symmetry::symmetric, conv::Symmetry::antisymmetric}) {
+        if (value == name(symmetry)) {
+            return symmetry;
+        }
+    }
+    throw std::invalid_argument(value);
+}
+
+// random weights in [-20, 20], mirrored for the symmetric filters; the first one is never 0, so that a random filter
+// stays asymmetric
+std::vector<int16_t> makeFilter(size_t hLen, conv::Symmetry symmetry, std::mt19937& random) {
+    std::vector<int16_t> h(hLen);
+    for (auto& weight : h) {
+        weight = static_cast<int16_t>(random() % 41) - 20;
+    }
+    h[0] = static_cast<int16_t>(random() % 20) + 1;
+    for (size_t i = 0; i < hLen / 2 and symmetry != conv::Symmetry::none; ++i) {
+        h[(hLen - 1) - i] = symmetry == conv::Symmetry::symmetric ? h[i] : -h[i];
+    }
+    if (hLen % 2 == 1 and symmetry == conv::Symmetry::antisymmetric) {
+        h[hLen / 2] = 0;
+    }
+    return h;
+}
+
+std::vector<Kernel> allKernels() {
+    std::vector<Kernel> kernels;
+    for (cpu::Isa isa : {cpu::Isa::generic, cpu::Isa::sse41, cpu::Isa::avx2, cpu::Isa::avx512bw}) {
+        kernels.push_back({cpu::name(isa), isa, conv::convolveFunction(isa)});
+    }
+    auto fftConvolver = std::make_shared<std::unique_ptr<conv::FftConvolver>>();
+    kernels.push_back({"fft", cpu::Isa::generic, [fftConvolver](const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+        if (not *fftConvolver or not (*fftConvolver)->hasFilter(h, hLen)) {
+            fftConvolver->reset(new conv::FftConvolver(h, hLen));
+        }
+        return (*fftConvolver)->convolve(x, y, yLen);
+    }});
+    auto planner = std::make_shared<conv::Planner>();
+    kernels.push_back({"planned", cpu::Isa::generic, [planner](const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+        return planner->convolve(x, h, hLen, y, yLen);
+    }});
+    return kernels;
+}
+
+// Times run() and fills in everything but the names and sizes. outputs and bytes are per run; bytes are the input and
+// output bytes.
+Result timeRuns(const std::function<void()>& run, size_t outputs, size_t bytes, const Options& options) {
+    // The first run builds any plans (the planner measures both methods), which would make the warmup runs look slow
+    // and cut the sample count. The warmup then fills the caches and the branch predictors and sizes the sample count
+    // to the time budget.
+    run();
+    using Clock = std::chrono::steady_clock;
+    auto startTime = Clock::now();
+    size_t warmupRuns = 0;
+    do {
+        run();
+        ++warmupRuns;
+    } while (warmupRuns < 2 or Clock::now() - startTime < options.budget / 10);
+    const Clock::duration runTime = (Clock::now() - startTime) / warmupRuns;
+    const size_t samples = std::min(options.maxSamples, std::max<size_t>(options.minSamples, options.budget / std::max(runTime, Clock::duration{1})));
+
+    std::vector<uint64_t> cycles(samples);
+    std::vector<double> seconds(samples);
+    perf::Counters counters;
+    counters.start();
+    for (size_t sample = 0; sample < samples; ++sample) {
+        const auto sampleStartTime = Clock::now();
+        const uint64_t startTicks = __rdtsc();
+        run();
+        cycles[sample] = __rdtsc() - startTicks;
+        seconds[sample] = std::chrono::duration<double>(Clock::now() - sampleStartTime).count();
+    }
+    counters.stop();
+
+    std::sort(cycles.begin(), cycles.end());
+    std::sort(seconds.begin(), seconds.end());
+    const size_t p99 = std::min(samples - 1, static_cast<size_t>(std::ceil(0.99 * samples)) - 1);
+
+    Result result{};
+    result.samples = samples;
+    result.medianCyclesPerOutput = static_cast<double>(cycles[samples / 2]) / outputs;
+    result.p99CyclesPerOutput = static_cast<double>(cycles[p99]) / outputs;
+    result.gbPerSecond = bytes / seconds[samples / 2] / 1e9;
+    for (int counter = 0; counter < perf::counterCount; ++counter) {
+        result.hasCounter[counter] = counters.available(static_cast<perf::Counter>(counter));
+        result.counterPerOutput[counter] = static_cast<double>(counters.value(static_cast<perf::Counter>(counter))) / (samples * outputs);
+    }
+    return result;
+}
+
+Result measure(const Kernel& kernel, size_t xLen, size_t hLen, conv::Symmetry symmetry, const Options& options) {
+    // enough padding for every kernel
+    const conv::Padding padding = conv::padding(conv::avx2Lanes, hLen);
+    const size_t yLen = xLen + hLen - 1;
+    std::mt19937 random(hLen);
+    const std::vector<int16_t> h = makeFilter(hLen, symmetry, random);
+    std::vector<int16_t> x(padding.inputBefore + xLen + padding.inputAfter);
+    std::vector<int16_t> y(yLen + padding.outputAfter);
+    for (size_t t = 0; t < xLen; ++t) {
+        x[padding.inputBefore + t] = static_cast<int16_t>(random());
+    }
+    Result result = timeRuns([&] {
+        kernel.convolve(x.data(), h.data(), hLen, y.data(), yLen);
+    }, yLen, (xLen + yLen) * sizeof(int16_t), options);
+    result.kernel = kernel.name;
+    result.symmetry = symmetry;
+    result.xLen = xLen;
+    result.hLen = hLen;
+    return result;
+}
+
+// channelCount channels of xLen samples each with the same filter: convolveBatch() as it chooses, either of its two
+// ways, or already interleaved data
+Result measureBatch(const std::string& kernel, size_t channelCount, size_t xLen, size_t hLen, conv::Symmetry symmetry, const Options& options) {
+    const conv::Padding padding = conv::batchPadding(hLen);
+    const size_t yLen = xLen + hLen - 1;
+    std::mt19937 random(hLen);
+    const std::vector<int16_t> h = makeFilter(hLen, symmetry, random);
+    std::vector<std::vector<int16_t>> x(channelCount, std::vector<int16_t>(padding.inputBefore + xLen + padding.inputAfter));
+    std::vector<std::vector<int16_t>> y(channelCount, std::vector<int16_t>(yLen + padding.outputAfter));
+    std::vector<const int16_t*> channelX;
+    std::vector<int16_t*> channelY;
+    for (size_t c = 0; c < channelCount; ++c) {
+        for (size_t t = 0; t < xLen; ++t) {
+            x[c][padding.inputBefore + t] = static_cast<int16_t>(random());
+        }
+        channelX.push_back(x[c].data());
+        channelY.push_back(y[c].data());
+    }
+    const size_t groupCount = (channelCount + conv::batchChannels - 1) / conv::batchChannels;
+    std::vector<std::vector<int16_t>> interleavedX(groupCount);
+    std::vector<std::vector<int16_t>> interleavedY(groupCount, std::vector<int16_t>(yLen * conv::batchChannels));
+    for (size_t group = 0; group < groupCount; ++group) {
+        const size_t first = group * conv::batchChannels;
+        interleavedX[group].resize((yLen + hLen - 1) * conv::batchChannels);
+        conv::interleave(&channelX[first], std::min(conv::batchChannels, channelCount - first), yLen + hLen - 1, interleavedX[group].data());
+    }
+
+    std::function<void()> run;
+    if (kernel == "batch") {
+        run = [&] { conv::convolveBatch(channelX.data(), channelCount, h.data(), hLen, channelY.data(), yLen); };
+    }
+    else if (kernel == "batch-transposed") {
+        run = [&] { conv::convolveTransposed(channelX.data(), channelCount, h.data(), hLen, channelY.data(), yLen); };
+    }
+    else if (kernel == "batch-separate") {
+        run = [&] {
+            for (size_t c = 0; c < channelCount; ++c) {
+                conv::convolve(channelX[c], h.data(), hLen, channelY[c], yLen);
+            }
+        };
+    }
+    else {
+        run = [&] {
+            for (size_t group = 0; group < groupCount; ++group) {
+                conv::convolveInterleaved(interleavedX[group].data(), h.data(), hLen, interleavedY[group].data(), yLen);
+            }
+        };
+    }
+    Result result = timeRuns(run, channelCount * yLen, channelCount * (xLen + yLen) * sizeof(int16_t), options);
+    result.kernel = kernel;
+    result.symmetry = symmetry;
+    result.shape = "channels=" + std::to_string(channelCount);
+    result.xLen = xLen;
+    result.hLen = hLen;
+    return result;
+}
+
+// decimate() or interpolate() of xLen input samples by factor, or the same from the full convolve() output: every
+// factor-th output kept, or the input stuffed with zeros first
+Result measureResample(const std::string& kernel, size_t factor, size_t xLen, size_t hLen, conv::Symmetry symmetry, const Options& options) {
+    const bool interpolating = kernel.rfind("interpolate", 0) == 0;
+    const size_t fullLen = (interpolating ? xLen * factor : xLen) + hLen - 1;
+    const size_t yLen = interpolating ? fullLen : (fullLen + factor - 1) / factor;
+    std::mt19937 random(hLen);
+    const std::vector<int16_t> h = makeFilter(hLen, symmetry, random);
+    // the input after its zeros, with zeros up to the last sample read
+    const size_t zeros = interpolating ? conv::phaseLen(hLen, factor) - 1 : hLen - 1;
+    const size_t readLen = interpolating ? zeros + (yLen - 1) / factor + 1 : (yLen - 1) * factor + hLen;
+    std::vector<int16_t> x(std::max(zeros + xLen, readLen));
+    for (size_t t = 0; t < xLen; ++t) {
+        x[zeros + t] = static_cast<int16_t>(random());
+    }
+    // input and output of the full convolution
+    const conv::Padding padding = conv::convolvePadding(hLen);
+    const size_t stuffedLen = interpolating ? xLen * factor : xLen;
+    std::vector<int16_t> stuffed(padding.inputBefore + stuffedLen + padding.inputAfter);
+    std::vector<int16_t> full(fullLen + padding.outputAfter);
+    std::vector<int16_t> y(yLen + padding.outputAfter);
+    // decimation convolves the input as it is; interpolation stuffs it into the zeros on every run
+    if (not interpolating) {
+        std::copy(&x[zeros], &x[zeros + xLen], &stuffed[padding.inputBefore]);
+    }
+
+    std::function<void()> run;
+    if (kernel == "decimate") {
+        run = [&] { conv::decimate(x.data(), h.data(), hLen, factor, y.data(), yLen); };
+    }
+    else if (kernel == "decimate-full") {
+        run = [&] {
+            conv::convolve(stuffed.data(), h.data(), hLen, full.data(), fullLen);
+            for (size_t k = 0; k < yLen; ++k) {
+                y[k] = full[k * factor];
+            }
+        };
+    }
+    else if (kernel == "interpolate") {
+        run = [&] { conv::interpolate(x.data(), h.data(), hLen, factor, y.data(), yLen); };
+    }
+    else {
+        run = [&] {
+            for (size_t t = 0; t < xLen; ++t) {
+                stuffed[padding.inputBefore + t * factor] = x[zeros + t];
+            }
+            conv::convolve(stuffed.data(), h.data(), hLen, y.data(), yLen);
+        };
+    }
+    Result result = timeRuns(run, yLen, (xLen + yLen) * sizeof(int16_t), options);
+    result.kernel = kernel;
+    result.symmetry = symmetry;
+    result.shape = "factor=" + std::to_string(factor);
+    result.xLen = xLen;
+    result.hLen = hLen;
+    return result;
+}
+
+// a width x height plane with a square kernel, the product of two random filters so that it is separable:
+// convolvePlane() as it chooses, or convolveSeparable() or convolveDirect()
+Result measurePlane(const std::string& kernel, PlaneSize plane, size_t kernelSize, conv::Symmetry symmetry, const Options& options) {
+    std::mt19937 random(kernelSize);
+    const std::vector<int16_t> vertical = makeFilter(kernelSize, symmetry, random);
+    const std::vector<int16_t> horizontal = makeFilter(kernelSize, symmetry, random);
+    std::vector<int16_t> weights(kernelSize * kernelSize);
+    for (size_t i = 0; i < kernelSize; ++i) {
+        for (size_t j = 0; j < kernelSize; ++j) {
+            weights[i * kernelSize + j] = vertical[i] * horizontal[j];
+        }
+    }
+    const size_t xStride = plane.width + kernelSize - 1;
+    std::vector<int16_t> x((plane.height + kernelSize - 1) * xStride);
+    std::vector<int16_t> y(plane.width * plane.height);
+    for (int16_t& sample : x) {
+        sample = static_cast<int16_t>(random());
+    }
+
+    std::function<void()> run;
+    if (kernel == "separable") {
+        run = [&] {
+            conv::convolveSeparable(x.data(), xStride, vertical.data(), kernelSize, horizontal.data(), kernelSize, y.data(), plane.width, plane.width, plane.height);
+        };
+    }
+    else if (kernel == "direct") {
+        run = [&] {
+            conv::convolveDirect(x.data(), xStride, weights.data(), kernelSize, kernelSize, y.data(), plane.width, plane.width, plane.height);
+        };
+    }
+    else {
+        run = [&] {
+            conv::convolvePlane(x.data(), xStride, weights.data(), kernelSize, kernelSize, y.data(), plane.width, plane.width, plane.height);
+        };
+    }
+    Result result = timeRuns(run, y.size(), (x.size() + y.size()) * sizeof(int16_t), options);
+    result.kernel = kernel;
+    result.symmetry = symmetry;
+    result.shape = "plane=" + std::to_string(plane.width) + "x" + std::to_string(plane.height);
+    result.xLen = y.size();
+    result.hLen = kernelSize;
+    return result;
+}
+
+// one result per line, so that readResults() does not need a real JSON parser
+void writeResults(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\n  \"cpu\": \"" << cpu::name(cpu::detect()) << "\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << "    {\"kernel\": \"" << result.kernel << "\", \"filter\": \"" << name(result.symmetry) << "\", \"shape\": \"" << result.shape << "\", \"xLen\": " << result.xLen << ", \"hLen\": " << result.hLen
+            << ", \"samples\": " << result.samples << ", \"medianCyclesPerOutput\": " << result.medianCyclesPerOutput
+            << ", \"p99CyclesPerOutput\": " << result.p99CyclesPerOutput << ", \"gbPerSecond\": " << result.gbPerSecond
+            << ", \"counters\": {";
+        for (int counter = 0; counter < perf::counterCount; ++counter) {
+            out << (counter > 0 ? ", " : "") << "\"" << perf::name(static_cast<perf::Counter>(counter)) << "PerOutput\": ";
+            if (result.hasCounter[counter]) {
+                out << result.counterPerOutput[counter];
+            }
+            else {
+                out << "null";
+            }
+        }
+        out << "}}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+std::string field(const std::string& line, const std::string& name) {
+    const std::string key = "\"" + name + "\": ";
+    const size_t begin = line.find(key);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    const size_t valueBegin = begin + key.size();
+    const size_t valueEnd = line.find_first_of(",}", valueBegin);
+    std::string value = line.substr(valueBegin, valueEnd - valueBegin);
+    value.erase(std::remove(value.begin(), value.end(), '"'), value.end());
+    return value;
+}
+
+using Key = std::tuple<std::string, std::string, std::string, size_t, size_t>;
+
+bool readResults(const std::string& path, std::map<Key, double>& medians) {
+    std::ifstream in(path);
+    if (not in) {
+        std::cerr << "cannot read " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        const std::string kernel = field(line, "kernel");
+        if (not kernel.empty()) {
+            // results from before the filter field were all asymmetric
+            const std::string filter = field(line, "filter");
+            const Key key{kernel, filter.empty() ? name(conv::Symmetry::none) : filter, field(line, "shape"), std::stoul(field(line, "xLen")), std::stoul(field(line, "hLen"))};
+            medians[key] = std::stod(field(line, "medianCyclesPerOutput"));
+        }
+    }
+    return true;
+}
+
+// returns the number of results that got slower than the threshold allows
+int compare(const std::string& baselinePath, const std::string& currentPath, double threshold) {
+    std::map<Key, double> baseline;
+    std::map<Key, double> current;
+    if (not readResults(baselinePath, baseline) or not readResults(currentPath, current)) {
+        return -1;
+    }
+    int regressions = 0;
+    for (const auto& result : current) {
+        const std::string& shape = std::get<2>(result.first);
+        std::cout << std::get<0>(result.first) << " filter=" << std::get<1>(result.first) << (shape.empty() ? "" : " ") << shape
+            << " xLen=" << std::get<3>(result.first) << " hLen=" << std::get<4>(result.first) << ": ";
+        const auto found = baseline.find(result.first);
+        if (found == baseline.end()) {
+            std::cout << "new, " << result.second << " cycles/output" << std::endl;
+            continue;
+        }
+        const double change = result.second / found->second - 1;
+        std::cout << found->second << " -> " << result.second << " cycles/output (" << (change >= 0 ? "+" : "") << change * 100 << "%)";
+        if (change > threshold) {
+            std::cout << " REGRESSION";
+            ++regressions;
+        }
+        else if (change < -threshold) {
+            std::cout << " improved";
+        }
+        std::cout << std::endl;
+    }
+    return regressions;
+}
+
+template<typename T, typename Parse>
+std::vector<T> parseList(const std::string& list, Parse parse) {
+    std::vector<T> values;
+    std::stringstream stream(list);
+    std::string value;
+    while (std::getline(stream, value, ',')) {
+        values.push_back(parse(value));
+    }
+    return values;
+}
+
+// WxH
+PlaneSize parsePlane(const std::string& value) {
+    size_t end = 0;
+    const size_t width = std::stoul(value, &end);
+    if (end >= value.size() or value[end] != 'x') {
+        throw std::invalid_argument(value);
+    }
+    const size_t height = std::stoul(value.substr(end + 1));
+    if (width == 0 or height == 0) {
+        throw std::invalid_argument(value);
+    }
+    return {width, height};
+}
+
+void usage(const char* program) {
+    std::cerr << "usage: " << program << " [--kernels NAME,...] [--lengths N,...] [--taps N,...] [--symmetry NAME,...] [--channels N,...] [--factors N,...] [--planes WxH,...] [--kernel-sizes N,...] [--budget-ms N] [--output FILE]" << std::endl;
+    std::cerr << "       " << program << " --compare BASELINE.json CURRENT.json [--threshold FRACTION]" << std::endl;
+    std::cerr << "kernels: generic, sse4.1, avx2, avx512bw, fft, planned (default: all supported)" << std::endl;
+    std::cerr << "         batch, batch-transposed, batch-separate, interleaved (only if listed; --channels per run)" << std::endl;
+    std::cerr << "         decimate, decimate-full, interpolate, interpolate-full (only if listed; --factors per run)" << std::endl;
+    std::cerr << "         plane, separable, direct (only if listed; --planes x --kernel-sizes instead of lengths and taps)" << std::endl;
+    std::cerr << "symmetry: none, symmetric, antisymmetric (default: none)" << std::endl;
+}
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    std::string outputPath;
+    std::string baselinePath;
+    std::string currentPath;
+    double threshold = 0.05;
+    try {
+        for (int arg = 1; arg < argc; ++arg) {
+            const std::string option{argv[arg]};
+            const bool hasValue = arg + 1 < argc;
+            if (option == "--kernels" and hasValue) {
+                options.kernels = parseList<std::string>(argv[++arg], [](const std::string& value) { return value; });
+            }
+            else if (option == "--lengths" and hasValue) {
+                options.lengths = parseList<size_t>(argv[++arg], [](const std::string& value) { return std::stoul(value); });
+            }
+            else if (option == "--taps" and hasValue) {
+                options.taps = parseList<size_t>(argv[++arg], [](const std::string& value) { return std::stoul(value); });
+            }
+            else if (option == "--channels" and hasValue) {
+                options.channelCounts = parseList<size_t>(argv[++arg], [](const std::string& value) { return std::stoul(value); });
+            }
+            else if (option == "--factors" and hasValue) {
+                options.factors = parseList<size_t>(argv[++arg], [](const std::string& value) {
+                    const size_t factor = std::stoul(value);
+                    return factor > 0 ? factor : throw std::invalid_argument(value);
+                });
+            }
+            else if (option == "--planes" and hasValue) {
+                options.planes = parseList<PlaneSize>(argv[++arg], parsePlane);
+            }
+            else if (option == "--kernel-sizes" and hasValue) {
+                options.kernelSizes = parseList<size_t>(argv[++arg], [](const std::string& value) { return std::stoul(value); });
+            }
+            else if (option == "--symmetry" and hasValue) {
+                options.symmetries = parseList<conv::Symmetry>(argv[++arg], parseSymmetry);
+            }
+            else if (option == "--budget-ms" and hasValue) {
+                options.budget = std::chrono::milliseconds{std::stoul(argv[++arg])};
+            }
+            else if (option == "--output" and hasValue) {
+                outputPath = argv[++arg];
+            }
+            else if (option == "--compare" and arg + 2 < argc) {
+                baselinePath = argv[++arg];
+                currentPath = argv[++arg];
+            }
+            else if (option == "--threshold" and hasValue) {
+                threshold = std::stod(argv[++arg]);
+            }
+            else {
+                usage(argv[0]);
+                return -1;
+            }
+        }
+    }
+    catch (const std::exception&) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (not baselinePath.empty()) {
+        const int regressions = compare(baselinePath, currentPath, threshold);
+        return regressions == 0 ? 0 : 1;
+    }
+
+    // the sweeps of the other modes only run when asked for
+    auto listed = [&](const std::string& name) {
+        return std::find(options.kernels.begin(), options.kernels.end(), name) != options.kernels.end();
+    };
+    std::vector<Kernel> kernels;
+    for (const Kernel& kernel : allKernels()) {
+        const bool selected = options.kernels.empty() or listed(kernel.name);
+        if (selected and cpu::supports(kernel.isa)) {
+            kernels.push_back(kernel);
+        }
+        else if (selected) {
+            std::cerr << "skipping " << kernel.name << ": not supported by this CPU" << std::endl;
+        }
+    }
+
+    std::vector<Result> results;
+    for (size_t xLen : options.lengths) {
+        for (size_t hLen : options.taps) {
+            for (conv::Symmetry symmetry : options.symmetries) {
+                for (const Kernel& kernel : kernels) {
+                    std::cerr << kernel.name << " filter=" << name(symmetry) << " xLen=" << xLen << " hLen=" << hLen << std::endl;
+                    results.push_back(measure(kernel, xLen, hLen, symmetry, options));
+                }
+            }
+        }
+    }
+    for (size_t channelCount : options.channelCounts) {
+        for (size_t xLen : options.lengths) {
+            for (size_t hLen : options.taps) {
+                for (conv::Symmetry symmetry : options.symmetries) {
+                    for (const char* kernel : {"batch", "batch-transposed", "batch-separate", "interleaved"}) {
+                        if (listed(kernel)) {
+                            std::cerr << kernel << " filter=" << name(symmetry) << " channels=" << channelCount << " xLen=" << xLen << " hLen=" << hLen << std::endl;
+                            results.push_back(measureBatch(kernel, channelCount, xLen, hLen, symmetry, options));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    for (size_t factor : options.factors) {
+        for (size_t xLen : options.lengths) {
+            for (size_t hLen : options.taps) {
+                for (conv::Symmetry symmetry : options.symmetries) {
+                    for (const char* kernel : {"decimate", "decimate-full", "interpolate", "interpolate-full"}) {
+                        if (listed(kernel)) {
+                            std::cerr << kernel << " filter=" << name(symmetry) << " factor=" << factor << " xLen=" << xLen << " hLen=" << hLen << std::endl;
+                            results.push_back(measureResample(kernel, factor, xLen, hLen, symmetry, options));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    for (PlaneSize plane : options.planes) {
+        for (size_t kernelSize : options.kernelSizes) {
+            for (conv::Symmetry symmetry : options.symmetries) {
+                for (const char* kernel : {"plane", "separable", "direct"}) {
+                    if (listed(kernel)) {
+                        std::cerr << kernel << " filter=" << name(symmetry) << " plane=" << plane.width << "x" << plane.height << " kernel=" << kernelSize << std::endl;
+                        results.push_back(measurePlane(kernel, plane, kernelSize, symmetry, options));
+                    }
+                }
+            }
+        }
+    }
+
+    if (outputPath.empty()) {
+        writeResults(std::cout, results);
+    }
+    else {
+        std::ofstream out(outputPath);
+        writeResults(out, results);
+        if (not out) {
+            std::cerr << "cannot write " << outputPath << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,328 @@
+#include "convolution.hpp"
+
+namespace conv {
+
+namespace {
+constexpr size_t blockRegisters = 4;
+}
+
+int16_t* naive(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen) {
+    for (size_t t = 0; t < yLen; ++t) {
+        y[t] = 0;
+        for (size_t i = 0; i < hLen; ++i) {
+            y[t] += h[i] * x[(hLen - 1) - i + t];
+        }
+    }
+    return y;
+}
+
+TARGET_SSE41 int16_t* blockedSse(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen) {
+    constexpr size_t blockLen = blockRegisters * sseLanes;
+    size_t t = 0;
+    for (; t + blockLen <= yLen; t += blockLen) {
+        __m128i sum[blockRegisters];
+        for (size_t j = 0; j < blockRegisters; ++j) {
+            sum[j] = _mm_setzero_si128();
+        }
+        for (size_t i = 0; i < hLen; ++i) {
+            const __m128i weight = _mm_set1_epi16(h[(hLen - 1) - i]);
+            for (size_t j = 0; j < blockRegisters; ++j) {
+                __m128i input = _mm_loadu_si128((const __m128i*)&x[t + i + j * sseLanes]);
+                sum[j] = _mm_add_epi16(sum[j], _mm_mullo_epi16(input, weight));
+            }
+        }
+        for (size_t j = 0; j < blockRegisters; ++j) {
+            _mm_storeu_si128((__m128i*)&y[t + j * sseLanes], sum[j]);
+        }
+    }
+    for (; t < yLen; t += sseLanes) {
+        __m128i sum = _mm_setzero_si128();
+        for (size_t i = 0; i < hLen; ++i) {
+            __m128i input = _mm_loadu_si128((const __m128i*)&x[t + i]);
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(input, _mm_set1_epi16(h[(hLen - 1) - i])));
+        }
+        _mm_storeu_si128((__m128i*)&y[t], sum);
+    }
+    return y;
+}
+
+TARGET_AVX2 int16_t* blockedAvx2(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen) {
+    constexpr size_t blockLen = blockRegisters * avx2Lanes;
+    size_t t = 0;
+    for (; t + blockLen <= yLen; t += blockLen) {
+        __m256i sum[blockRegisters];
+        for (size_t j = 0; j < blockRegisters; ++j) {
+            sum[j] = _mm256_setzero_si256();
+        }
+        for (size_t i = 0; i < hLen; ++i) {
+            const __m256i weight = _mm256_set1_epi16(h[(hLen - 1) - i]);
+            for (size_t j = 0; j < blockRegisters; ++j) {
+                __m256i input = _mm256_loadu_si256((const __m256i*)&x[t + i + j * avx2Lanes]);
+                sum[j] = _mm256_add_epi16(sum[j], _mm256_mullo_epi16(input, weight));
+            }
+        }
+        for (size_t j = 0; j < blockRegisters; ++j) {
+            _mm256_storeu_si256((__m256i*)&y[t + j * avx2Lanes], sum[j]);
+        }
+    }
+    for (; t < yLen; t += avx2Lanes) {
+        __m256i sum = _mm256_setzero_si256();
+        for (size_t i = 0; i < hLen; ++i) {
+            __m256i input = _mm256_loadu_si256((const __m256i*)&x[t + i]);
+            sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(input, _mm256_set1_epi16(h[(hLen - 1) - i])));
+        }
+        _mm256_storeu_si256((__m256i*)&y[t], sum);
+    }
+    return y;
+}
+
+TARGET_AVX512BW int16_t* blockedAvx512(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen) {
+    constexpr size_t blockLen = blockRegisters * avx512Lanes;
+    size_t t = 0;
+    for (; t + blockLen <= yLen; t += blockLen) {
+        __m512i sum[blockRegisters];
+        for (size_t j = 0; j < blockRegisters; ++j) {
+            sum[j] = _mm512_setzero_si512();
+        }
+        for (size_t i = 0; i < hLen; ++i) {
+            const __m512i weight = _mm512_set1_epi16(h[(hLen - 1) - i]);
+            for (size_t j = 0; j < blockRegisters; ++j) {
+                __m512i input = _mm512_loadu_si512(&x[t + i + j * avx512Lanes]);
+                sum[j] = _mm512_add_epi16(sum[j], _mm512_mullo_epi16(input, weight));
+            }
+        }
+        for (size_t j = 0; j < blockRegisters; ++j) {
+            _mm512_storeu_si512(&y[t + j * avx512Lanes], sum[j]);
+        }
+    }
+    for (; t < yLen; t += avx512Lanes) {
+        const __mmask32 mask = yLen - t < avx512Lanes ? (1u << (yLen - t)) - 1 : ~0u;
+        __m512i sum = _mm512_setzero_si512();
+        for (size_t i = 0; i < hLen; ++i) {
+            __m512i input = _mm512_maskz_loadu_epi16(mask, &x[t + i]);
+            sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(input, _mm512_set1_epi16(h[(hLen - 1) - i])));
+        }
+        _mm512_mask_storeu_epi16(&y[t], mask, sum);
+    }
+    return y;
+}
+
+Symmetry symmetry(const int16_t* h, size_t hLen) {
+    bool symmetric = true;
+    bool antisymmetric = true;
+    for (size_t i = 0; i <= (hLen - 1) / 2 and hLen > 0; ++i) {
+        const int first = h[i];
+        const int last = h[(hLen - 1) - i];
+        symmetric = symmetric and first == last;
+        antisymmetric = antisymmetric and first == -last;
+    }
+    return symmetric ? Symmetry::symmetric : antisymmetric ? Symmetry::antisymmetric : Symmetry::none;
+}
+
+namespace {
+template<bool Antisymmetric>
+int16_t* foldedNaive(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen) {
+    const size_t pairs = hLen / 2;
+    const bool hasMiddle = hLen % 2 == 1 and not Antisymmetric;
+    for (size_t t = 0; t < yLen; ++t) {
+        int16_t sum = hasMiddle ? h[pairs] * x[t + pairs] : 0;
+        for (size_t i = 0; i < pairs; ++i) {
+            const int16_t folded = Antisymmetric ? x[t + i] - x[t + (hLen - 1) - i] : x[t + i] + x[t + (hLen - 1) - i];
+            sum += h[(hLen - 1) - i] * folded;
+        }
+        y[t] = sum;
+    }
+    return y;
+}
+
+// Registers consecutive registers of outputs from t on; the blocked loops use this for whole blocks and for the rest
+// one register at a time
+template<bool Antisymmetric, size_t Registers>
+TARGET_SSE41 void foldedRoundSse(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t t) {
+    const size_t pairs = hLen / 2;
+    const bool hasMiddle = hLen % 2 == 1 and not Antisymmetric;
+    __m128i sum[Registers];
+    for (size_t j = 0; j < Registers; ++j) {
+        __m128i middle = _mm_loadu_si128((const __m128i*)&x[t + pairs + j * sseLanes]);
+        sum[j] = hasMiddle ? _mm_mullo_epi16(middle, _mm_set1_epi16(h[pairs])) : _mm_setzero_si128();
+    }
+    for (size_t i = 0; i < pairs; ++i) {
+        const __m128i weight = _mm_set1_epi16(h[(hLen - 1) - i]);
+        for (size_t j = 0; j < Registers; ++j) {
+            __m128i first = _mm_loadu_si128((const __m128i*)&x[t + i + j * sseLanes]);
+            __m128i last = _mm_loadu_si128((const __m128i*)&x[t + (hLen - 1) - i + j * sseLanes]);
+            __m128i folded = Antisymmetric ? _mm_sub_epi16(first, last) : _mm_add_epi16(first, last);
+            sum[j] = _mm_add_epi16(sum[j], _mm_mullo_epi16(folded, weight));
+        }
+    }
+    for (size_t j = 0; j < Registers; ++j) {
+        _mm_storeu_si128((__m128i*)&y[t + j * sseLanes], sum[j]);
+    }
+}
+
+template<bool Antisymmetric>
+TARGET_SSE41 int16_t* blockedFoldedSse(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen) {
+    size_t t = 0;
+    for (; t + blockRegisters * sseLanes <= yLen; t += blockRegisters * sseLanes) {
+        foldedRoundSse<Antisymmetric, blockRegisters>(x, h, hLen, y, t);
+    }
+    for (; t < yLen; t += sseLanes) {
+        foldedRoundSse<Antisymmetric, 1>(x, h, hLen, y, t);
+    }
+    return y;
+}
+
+template<bool Antisymmetric, size_t Registers>
+TARGET_AVX2 void foldedRoundAvx2(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t t) {
+    const size_t pairs = hLen / 2;
+    const bool hasMiddle = hLen % 2 == 1 and not Antisymmetric;
+    __m256i sum[Registers];
+    for (size_t j = 0; j < Registers; ++j) {
+        __m256i middle = _mm256_loadu_si256((const __m256i*)&x[t + pairs + j * avx2Lanes]);
+        sum[j] = hasMiddle ? _mm256_mullo_epi16(middle, _mm256_set1_epi16(h[pairs])) : _mm256_setzero_si256();
+    }
+    for (size_t i = 0; i < pairs; ++i) {
+        const __m256i weight = _mm256_set1_epi16(h[(hLen - 1) - i]);
+        for (size_t j = 0; j < Registers; ++j) {
+            __m256i first = _mm256_loadu_si256((const __m256i*)&x[t + i + j * avx2Lanes]);
+            __m256i last = _mm256_loadu_si256((const __m256i*)&x[t + (hLen - 1) - i + j * avx2Lanes]);
+            __m256i folded = Antisymmetric ? _mm256_sub_epi16(first, last) : _mm256_add_epi16(first, last);
+            sum[j] = _mm256_add_epi16(sum[j], _mm256_mullo_epi16(folded, weight));
+        }
+    }
+    for (size_t j = 0; j < Registers; ++j) {
+        _mm256_storeu_si256((__m256i*)&y[t + j * avx2Lanes], sum[j]);
+    }
+}
+
+template<bool Antisymmetric>
+TARGET_AVX2 int16_t* blockedFoldedAvx2(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen) {
+    size_t t = 0;
+    for (; t + blockRegisters * avx2Lanes <= yLen; t += blockRegisters * avx2Lanes) {
+        foldedRoundAvx2<Antisymmetric, blockRegisters>(x, h, hLen, y, t);
+    }
+    for (; t < yLen; t += avx2Lanes) {
+        foldedRoundAvx2<Antisymmetric, 1>(x, h, hLen, y, t);
+    }
+    return y;
+}
+
+// mask selects the lanes of the last register; the others are always whole
+template<bool Antisymmetric, size_t Registers>
+TARGET_AVX512BW void foldedRoundAvx512(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t t, __mmask32 mask) {
+    const size_t pairs = hLen / 2;
+    const bool hasMiddle = hLen % 2 == 1 and not Antisymmetric;
+    __mmask32 masks[Registers];
+    __m512i sum[Registers];
+    for (size_t j = 0; j < Registers; ++j) {
+        masks[j] = j + 1 < Registers ? ~0u : mask;
+        __m512i middle = _mm512_maskz_loadu_epi16(masks[j], &x[t + pairs + j * avx512Lanes]);
+        sum[j] = hasMiddle ? _mm512_mullo_epi16(middle, _mm512_set1_epi16(h[pairs])) : _mm512_setzero_si512();
+    }
+    for (size_t i = 0; i < pairs; ++i) {
+        const __m512i weight = _mm512_set1_epi16(h[(hLen - 1) - i]);
+        for (size_t j = 0; j < Registers; ++j) {
+            __m512i first = _mm512_maskz_loadu_epi16(masks[j], &x[t + i + j * avx512Lanes]);
+            __m512i last = _mm512_maskz_loadu_epi16(masks[j], &x[t + (hLen - 1) - i + j * avx512Lanes]);
+            __m512i folded = Antisymmetric ? _mm512_sub_epi16(first, last) : _mm512_add_epi16(first, last);
+            sum[j] = _mm512_add_epi16(sum[j], _mm512_mullo_epi16(folded, weight));
+        }
+    }
+    for (size_t j = 0; j < Registers; ++j) {
+        _mm512_mask_storeu_epi16(&y[t + j * avx512Lanes], masks[j], sum[j]);
+    }
+}
+
+template<bool Antisymmetric>
+TARGET_AVX512BW int16_t* blockedFoldedAvx512(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen) {
+    size_t t = 0;
+    for (; t + blockRegisters * avx512Lanes <= yLen; t += blockRegisters * avx512Lanes) {
+        foldedRoundAvx512<Antisymmetric, blockRegisters>(x, h, hLen, y, t, ~0u);
+    }
+    for (; t < yLen; t += avx512Lanes) {
+        const __mmask32 mask = yLen - t < avx512Lanes ? (1u << (yLen - t)) - 1 : ~0u;
+        foldedRoundAvx512<Antisymmetric, 1>(x, h, hLen, y, t, mask);
+    }
+    return y;
+}
+
+template<bool Antisymmetric>
+int16_t* convolveFoldedSse(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    return dispatchLength(hLen, [&](auto length) { return foldedSse<decltype(length)::value, Antisymmetric>(x, h, y, yLen); },
+        [&] { return blockedFoldedSse<Antisymmetric>(x, h, hLen, y, yLen); });
+}
+
+template<bool Antisymmetric>
+int16_t* convolveFoldedAvx2(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    return dispatchLength(hLen, [&](auto length) { return foldedAvx2<decltype(length)::value, Antisymmetric>(x, h, y, yLen); },
+        [&] { return blockedFoldedAvx2<Antisymmetric>(x, h, hLen, y, yLen); });
+}
+
+template<bool Antisymmetric>
+int16_t* convolveFoldedAvx512(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    return dispatchLength(hLen, [&](auto length) { return foldedAvx512<decltype(length)::value, Antisymmetric>(x, h, y, yLen); },
+        [&] { return blockedFoldedAvx512<Antisymmetric>(x, h, hLen, y, yLen); });
+}
+}
+
+namespace {
+int16_t* convolveGeneric(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    switch (symmetry(h, hLen)) {
+        case Symmetry::symmetric: return foldedNaive<false>(x, h, hLen, y, yLen);
+        case Symmetry::antisymmetric: return foldedNaive<true>(x, h, hLen, y, yLen);
+        case Symmetry::none: break;
+    }
+    return dispatchLength(hLen, [&](auto length) { return naive<decltype(length)::value>(x, h, y, yLen); },
+        [&] { return naive(x, h, hLen, y, yLen); });
+}
+
+int16_t* convolveSse(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    switch (symmetry(h, hLen)) {
+        case Symmetry::symmetric: return convolveFoldedSse<false>(x, h, hLen, y, yLen);
+        case Symmetry::antisymmetric: return convolveFoldedSse<true>(x, h, hLen, y, yLen);
+        case Symmetry::none: break;
+    }
+    return dispatchLength(hLen, [&](auto length) { return smartSse<decltype(length)::value>(x, h, y, yLen); },
+        [&] { return blockedSse(x, h, hLen, y, yLen); });
+}
+
+int16_t* convolveAvx2(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    switch (symmetry(h, hLen)) {
+        case Symmetry::symmetric: return convolveFoldedAvx2<false>(x, h, hLen, y, yLen);
+        case Symmetry::antisymmetric: return convolveFoldedAvx2<true>(x, h, hLen, y, yLen);
+        case Symmetry::none: break;
+    }
+    return dispatchLength(hLen, [&](auto length) { return smartAvx2<decltype(length)::value>(x, h, y, yLen); },
+        [&] { return blockedAvx2(x, h, hLen, y, yLen); });
+}
+
+int16_t* convolveAvx512(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    switch (symmetry(h, hLen)) {
+        case Symmetry::symmetric: return convolveFoldedAvx512<false>(x, h, hLen, y, yLen);
+        case Symmetry::antisymmetric: return convolveFoldedAvx512<true>(x, h, hLen, y, yLen);
+        case Symmetry::none: break;
+    }
+    return dispatchLength(hLen, [&](auto length) { return smartAvx512<decltype(length)::value>(x, h, y, yLen); },
+        [&] { return blockedAvx512(x, h, hLen, y, yLen); });
+}
+}
+
+ConvolveFunction convolveFunction(cpu::Isa isa) {
+    switch (isa) {
+        case cpu::Isa::generic: return convolveGeneric;
+        case cpu::Isa::sse41: return convolveSse;
+        case cpu::Isa::avx2: return convolveAvx2;
+        case cpu::Isa::avx512bw: return convolveAvx512;
+    }
+    return convolveGeneric;
+}
+
+int16_t* convolve(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    static const ConvolveFunction selected = convolveFunction(cpu::detect());
+    return selected(x, h, hLen, y, yLen);
+}
+
+Padding convolvePadding(size_t hLen) {
+    return padding(cpu::detect(), hLen);
+}
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <immintrin.h>
+#include <type_traits>
+#include <utility>
+#include "cpu.hpp"
+
+// Convolution kernels for arbitrary filters: y[t] = h[0] * x[hLen - 1 + t] + ... + h[hLen - 1] * x[t]
+//
+// The input x is expected to start with hLen - 1 zeros (the samples "before" t = 0), so that yLen = xLen + hLen - 1
+// outputs can be calculated without any bounds checks. The SSE and AVX2 kernels process whole registers at a time, so
+// both the input and the output have to have some extra room in the end; padding() tells how much. The AVX-512 kernels
+// mask the last round instead and only need the hLen - 1 zeros after the input that the convolution itself implies.
+namespace conv {
+
+constexpr size_t sseLanes = 8;
+constexpr size_t avx2Lanes = 16;
+constexpr size_t avx512Lanes = 32;
+
+struct Padding {
+    size_t inputBefore; // zeros before the first sample of x
+    size_t inputAfter;  // zeros after the last sample of x
+    size_t outputAfter; // writable elements after y[yLen - 1]
+};
+
+// the last round starts at most lanes - 1 elements before yLen and reads hLen - 1 elements further
+constexpr Padding padding(size_t lanes, size_t hLen) {
+    return {hLen - 1, (hLen - 1) + (lanes - 1), lanes - 1};
+}
+
+constexpr Padding padding(cpu::Isa isa, size_t hLen) {
+    return isa == cpu::Isa::sse41 ? padding(sseLanes, hLen)
+        : isa == cpu::Isa::avx2 ? padding(avx2Lanes, hLen)
+        : Padding{hLen - 1, hLen - 1, 0};
+}
+
+template<size_t HLen>
+int16_t* naive(const int16_t* __restrict__ x, const int16_t* __restrict__ h, int16_t* __restrict__ y, size_t yLen) {
+    for (size_t t = 0; t < yLen; ++t) {
+        y[t] = 0;
+        for (size_t i = 0; i < HLen; ++i) {
+            y[t] += h[i] * x[(HLen - 1) - i + t];
+        }
+    }
+    return y;
+}
+
+// same as smartSse in main.cpp, but the filter is reversed so that it does not have to be symmetrical
+template<size_t HLen>
+TARGET_SSE41 int16_t* smartSse(const int16_t* __restrict__ x, const int16_t* __restrict__ h, int16_t* __restrict__ y, size_t yLen) {
+    __m128i mFilter[HLen];
+    for (size_t i = 0; i < HLen; ++i) {
+        mFilter[i] = _mm_set1_epi16(h[(HLen - 1) - i]);
+    }
+    for (size_t t = 0; t < yLen; t += sseLanes) {
+        __m128i sum = _mm_mullo_epi16(_mm_loadu_si128((const __m128i*)&x[t]), mFilter[0]);
+        for (size_t i = 1; i < HLen; ++i) {
+            __m128i input = _mm_loadu_si128((const __m128i*)&x[t + i]);
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(input, mFilter[i]));
+        }
+        _mm_storeu_si128((__m128i*)&y[t], sum);
+    }
+    return y;
+}
+
+template<size_t HLen>
+TARGET_AVX2 int16_t* smartAvx2(const int16_t* __restrict__ x, const int16_t* __restrict__ h, int16_t* __restrict__ y, size_t yLen) {
+    __m256i mFilter[HLen];
+    for (size_t i = 0; i < HLen; ++i) {
+        mFilter[i] = _mm256_set1_epi16(h[(HLen - 1) - i]);
+    }
+    for (size_t t = 0; t < yLen; t += avx2Lanes) {
+        __m256i sum = _mm256_mullo_epi16(_mm256_loadu_si256((const __m256i*)&x[t]), mFilter[0]);
+        for (size_t i = 1; i < HLen; ++i) {
+            __m256i input = _mm256_loadu_si256((const __m256i*)&x[t + i]);
+            sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(input, mFilter[i]));
+        }
+        _mm256_storeu_si256((__m256i*)&y[t], sum);
+    }
+    return y;
+}
+
+// smartAvx2 with 32 samples per round; the last round loads and stores only the lanes below yLen
+template<size_t HLen>
+TARGET_AVX512BW int16_t* smartAvx512(const int16_t* __restrict__ x, const int16_t* __restrict__ h, int16_t* __restrict__ y, size_t yLen) {
+    __m512i mFilter[HLen];
+    for (size_t i = 0; i < HLen; ++i) {
+        mFilter[i] = _mm512_set1_epi16(h[(HLen - 1) - i]);
+    }
+    size_t t = 0;
+    for (; t + avx512Lanes <= yLen; t += avx512Lanes) {
+        __m512i sum = _mm512_mullo_epi16(_mm512_loadu_si512(&x[t]), mFilter[0]);
+        for (size_t i = 1; i < HLen; ++i) {
+            __m512i input = _mm512_loadu_si512(&x[t + i]);
+            sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(input, mFilter[i]));
+        }
+        _mm512_storeu_si512(&y[t], sum);
+    }
+    if (t < yLen) {
+        const __mmask32 mask = (1u << (yLen - t)) - 1;
+        __m512i sum = _mm512_mullo_epi16(_mm512_maskz_loadu_epi16(mask, &x[t]), mFilter[0]);
+        for (size_t i = 1; i < HLen; ++i) {
+            __m512i input = _mm512_maskz_loadu_epi16(mask, &x[t + i]);
+            sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(input, mFilter[i]));
+        }
+        _mm512_mask_storeu_epi16(&y[t], mask, sum);
+    }
+    return y;
+}
+
+// Linear-phase filters have h[i] == h[hLen - 1 - i] (symmetric) or h[i] == -h[hLen - 1 - i] (antisymmetric, with a
+// zero in the middle). The folded kernels add (or subtract) the mirrored inputs x[t + i] and x[t + hLen - 1 - i]
+// first and multiply the sum only once, which halves the multiplies.
+enum class Symmetry {
+    none,
+    symmetric,
+    antisymmetric,
+};
+
+Symmetry symmetry(const int16_t* h, size_t hLen);
+
+template<size_t HLen, bool Antisymmetric>
+TARGET_SSE41 int16_t* foldedSse(const int16_t* __restrict__ x, const int16_t* __restrict__ h, int16_t* __restrict__ y, size_t yLen) {
+    constexpr size_t pairs = HLen / 2;
+    constexpr bool hasMiddle = HLen % 2 == 1 and not Antisymmetric;
+    __m128i mFilter[pairs + 1];
+    for (size_t i = 0; i <= pairs; ++i) {
+        mFilter[i] = _mm_set1_epi16(h[(HLen - 1) - i]);
+    }
+    for (size_t t = 0; t < yLen; t += sseLanes) {
+        __m128i sum = hasMiddle ? _mm_mullo_epi16(_mm_loadu_si128((const __m128i*)&x[t + pairs]), mFilter[pairs]) : _mm_setzero_si128();
+        for (size_t i = 0; i < pairs; ++i) {
+            __m128i first = _mm_loadu_si128((const __m128i*)&x[t + i]);
+            __m128i last = _mm_loadu_si128((const __m128i*)&x[t + (HLen - 1) - i]);
+            __m128i folded = Antisymmetric ? _mm_sub_epi16(first, last) : _mm_add_epi16(first, last);
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(folded, mFilter[i]));
+        }
+        _mm_storeu_si128((__m128i*)&y[t], sum);
+    }
+    return y;
+}
+
+template<size_t HLen, bool Antisymmetric>
+TARGET_AVX2 int16_t* foldedAvx2(const int16_t* __restrict__ x, const int16_t* __restrict__ h, int16_t* __restrict__ y, size_t yLen) {
+    constexpr size_t pairs = HLen / 2;
+    constexpr bool hasMiddle = HLen % 2 == 1 and not Antisymmetric;
+    __m256i mFilter[pairs + 1];
+    for (size_t i = 0; i <= pairs; ++i) {
+        mFilter[i] = _mm256_set1_epi16(h[(HLen - 1) - i]);
+    }
+    for (size_t t = 0; t < yLen; t += avx2Lanes) {
+        __m256i sum = hasMiddle ? _mm256_mullo_epi16(_mm256_loadu_si256((const __m256i*)&x[t + pairs]), mFilter[pairs]) : _mm256_setzero_si256();
+        for (size_t i = 0; i < pairs; ++i) {
+            __m256i first = _mm256_loadu_si256((const __m256i*)&x[t + i]);
+            __m256i last = _mm256_loadu_si256((const __m256i*)&x[t + (HLen - 1) - i]);
+            __m256i folded = Antisymmetric ? _mm256_sub_epi16(first, last) : _mm256_add_epi16(first, last);
+            sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(folded, mFilter[i]));
+        }
+        _mm256_storeu_si256((__m256i*)&y[t], sum);
+    }
+    return y;
+}
+
+// like smartAvx512, the last round loads and stores only the lanes below yLen
+template<size_t HLen, bool Antisymmetric>
+TARGET_AVX512BW int16_t* foldedAvx512(const int16_t* __restrict__ x, const int16_t* __restrict__ h, int16_t* __restrict__ y, size_t yLen) {
+    constexpr size_t pairs = HLen / 2;
+    constexpr bool hasMiddle = HLen % 2 == 1 and not Antisymmetric;
+    __m512i mFilter[pairs + 1];
+    for (size_t i = 0; i <= pairs; ++i) {
+        mFilter[i] = _mm512_set1_epi16(h[(HLen - 1) - i]);
+    }
+    size_t t = 0;
+    for (; t + avx512Lanes <= yLen; t += avx512Lanes) {
+        __m512i sum = hasMiddle ? _mm512_mullo_epi16(_mm512_loadu_si512(&x[t + pairs]), mFilter[pairs]) : _mm512_setzero_si512();
+        for (size_t i = 0; i < pairs; ++i) {
+            __m512i first = _mm512_loadu_si512(&x[t + i]);
+            __m512i last = _mm512_loadu_si512(&x[t + (HLen - 1) - i]);
+            __m512i folded = Antisymmetric ? _mm512_sub_epi16(first, last) : _mm512_add_epi16(first, last);
+            sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(folded, mFilter[i]));
+        }
+        _mm512_storeu_si512(&y[t], sum);
+    }
+    if (t < yLen) {
+        const __mmask32 mask = (1u << (yLen - t)) - 1;
+        __m512i sum = hasMiddle ? _mm512_mullo_epi16(_mm512_maskz_loadu_epi16(mask, &x[t + pairs]), mFilter[pairs]) : _mm512_setzero_si512();
+        for (size_t i = 0; i < pairs; ++i) {
+            __m512i first = _mm512_maskz_loadu_epi16(mask, &x[t + i]);
+            __m512i last = _mm512_maskz_loadu_epi16(mask, &x[t + (HLen - 1) - i]);
+            __m512i folded = Antisymmetric ? _mm512_sub_epi16(first, last) : _mm512_add_epi16(first, last);
+            sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(folded, mFilter[i]));
+        }
+        _mm512_mask_storeu_epi16(&y[t], mask, sum);
+    }
+    return y;
+}
+
+// The filter lengths that the runtime entry points instantiate the templates above for
+using SpecializedLengths = std::index_sequence<3, 5, 7, 9, 11, 15, 31, 63>;
+
+// specialized(std::integral_constant<size_t, hLen>()) if hLen is one of Lengths, fallback() otherwise
+template<typename Specialized, typename Fallback, size_t... Lengths>
+auto dispatchLength(size_t hLen, Specialized specialized, Fallback fallback, std::index_sequence<Lengths...>) {
+    decltype(fallback()) result{};
+    const bool found = ((hLen == Lengths and (result = specialized(std::integral_constant<size_t, Lengths>()), true)) or ...);
+    return found ? result : fallback();
+}
+
+template<typename Specialized, typename Fallback>
+auto dispatchLength(size_t hLen, Specialized specialized, Fallback fallback) {
+    return dispatchLength(hLen, specialized, fallback, SpecializedLengths());
+}
+
+// Fallbacks for filter lengths without a specialization: the filter does not fit into registers, so instead
+// each weight is broadcast once per block of outputs and accumulated into several registers at the same time.
+int16_t* naive(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen);
+TARGET_SSE41 int16_t* blockedSse(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen);
+TARGET_AVX2 int16_t* blockedAvx2(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen);
+TARGET_AVX512BW int16_t* blockedAvx512(const int16_t* __restrict__ x, const int16_t* __restrict__ h, size_t hLen, int16_t* __restrict__ y, size_t yLen);
+
+using ConvolveFunction = int16_t* (*)(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen);
+
+// Runtime entry points: use the specialization for hLen if there is one, the blocked fallback otherwise, and the folded
+// variants of either when the filter is symmetric or antisymmetric. The kernels for the given instruction set must be
+// supported by the CPU.
+ConvolveFunction convolveFunction(cpu::Isa isa);
+
+// convolveFunction() for the widest instruction set of this CPU, selected once
+int16_t* convolve(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen);
+Padding convolvePadding(size_t hLen);
+}
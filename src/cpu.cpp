@@ -0,0 +1,54 @@
+#include "cpu.hpp"
+#include <cpuid.h>
+#include <cstdint>
+
+namespace cpu {
+
+namespace {
+// XCR0 tells which register states the OS saves on context switches
+uint64_t xgetbv() {
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+}
+
+Isa query() {
+    unsigned int eax, ebx, ecx, edx;
+    if (not __get_cpuid(1, &eax, &ebx, &ecx, &edx) or not (ecx & bit_SSE4_1)) {
+        return Isa::generic;
+    }
+    if (not (ecx & bit_OSXSAVE) or not (ecx & bit_AVX)) {
+        return Isa::sse41;
+    }
+    const uint64_t xcr0 = xgetbv();
+    const bool ymmEnabled = (xcr0 & 0x06) == 0x06;       // SSE, AVX
+    const bool zmmEnabled = (xcr0 & 0xe6) == 0xe6;       // SSE, AVX, opmask, ZMM_Hi256, Hi16_ZMM
+    if (not ymmEnabled or not __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) or not (ebx & bit_AVX2)) {
+        return Isa::sse41;
+    }
+    if (not zmmEnabled or not (ebx & bit_AVX512F) or not (ebx & bit_AVX512BW)) {
+        return Isa::avx2;
+    }
+    return Isa::avx512bw;
+}
+}
+
+Isa detect() {
+    static const Isa isa = query();
+    return isa;
+}
+
+bool supports(Isa isa) {
+    return isa <= detect();
+}
+
+const char* name(Isa isa) {
+    switch (isa) {
+        case Isa::generic: return "generic";
+        case Isa::sse41: return "sse4.1";
+        case Isa::avx2: return "avx2";
+        case Isa::avx512bw: return "avx512bw";
+    }
+    return "unknown";
+}
+}
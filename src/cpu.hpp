@@ -0,0 +1,24 @@
+#pragma once
+
+// The binary is built for the generic x86-64 baseline; every function using wider instructions than that is
+// marked with one of these and must only be called after checking cpu::supports().
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512BW __attribute__((target("avx512f,avx512bw")))
+
+namespace cpu {
+
+// ordered from narrowest to widest
+enum class Isa {
+    generic,
+    sse41,
+    avx2,
+    avx512bw,
+};
+
+// widest instruction set supported by both the CPU and the OS, queried once with cpuid
+Isa detect();
+
+bool supports(Isa isa);
+const char* name(Isa isa);
+}
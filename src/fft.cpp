@@ -0,0 +1,276 @@
+#include "fft.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace conv {
+
+namespace {
+constexpr size_t maxFftLen = 1 << 16;
+constexpr size_t maxMeasuredLen = 1 << 16;
+// FFT convolvers a Planner keeps; all are dropped when one more filter comes
+constexpr size_t maxCachedFilters = 16;
+
+// one radix-2 stage: pairs x[j + k] and x[j + k + m] for every group j of 2 * m elements
+void butterflies(double* re, double* im, size_t len, size_t m, const double* twiddleRe, const double* twiddleIm) {
+    for (size_t j = 0; j < len; j += 2 * m) {
+        for (size_t k = 0; k < m; ++k) {
+            const double vRe = re[j + k + m] * twiddleRe[k] - im[j + k + m] * twiddleIm[k];
+            const double vIm = re[j + k + m] * twiddleIm[k] + im[j + k + m] * twiddleRe[k];
+            re[j + k + m] = re[j + k] - vRe;
+            im[j + k + m] = im[j + k] - vIm;
+            re[j + k] += vRe;
+            im[j + k] += vIm;
+        }
+    }
+}
+
+// m has to be a multiple of 4
+TARGET_AVX2 void butterfliesAvx2(double* re, double* im, size_t len, size_t m, const double* twiddleRe, const double* twiddleIm) {
+    for (size_t j = 0; j < len; j += 2 * m) {
+        for (size_t k = 0; k < m; k += 4) {
+            const __m256d wRe = _mm256_loadu_pd(&twiddleRe[k]);
+            const __m256d wIm = _mm256_loadu_pd(&twiddleIm[k]);
+            const __m256d uRe = _mm256_loadu_pd(&re[j + k]);
+            const __m256d uIm = _mm256_loadu_pd(&im[j + k]);
+            const __m256d xRe = _mm256_loadu_pd(&re[j + k + m]);
+            const __m256d xIm = _mm256_loadu_pd(&im[j + k + m]);
+            const __m256d vRe = _mm256_sub_pd(_mm256_mul_pd(xRe, wRe), _mm256_mul_pd(xIm, wIm));
+            const __m256d vIm = _mm256_add_pd(_mm256_mul_pd(xRe, wIm), _mm256_mul_pd(xIm, wRe));
+            _mm256_storeu_pd(&re[j + k], _mm256_add_pd(uRe, vRe));
+            _mm256_storeu_pd(&im[j + k], _mm256_add_pd(uIm, vIm));
+            _mm256_storeu_pd(&re[j + k + m], _mm256_sub_pd(uRe, vRe));
+            _mm256_storeu_pd(&im[j + k + m], _mm256_sub_pd(uIm, vIm));
+        }
+    }
+}
+
+// the two first stages, where the twiddles are 1 and -i
+void radix4(double* re, double* im, size_t len) {
+    for (size_t j = 0; j < len; j += 4) {
+        const double a0Re = re[j] + re[j + 1], a0Im = im[j] + im[j + 1];
+        const double a1Re = re[j] - re[j + 1], a1Im = im[j] - im[j + 1];
+        const double a2Re = re[j + 2] + re[j + 3], a2Im = im[j + 2] + im[j + 3];
+        const double a3Re = re[j + 2] - re[j + 3], a3Im = im[j + 2] - im[j + 3];
+        re[j] = a0Re + a2Re;
+        im[j] = a0Im + a2Im;
+        re[j + 2] = a0Re - a2Re;
+        im[j + 2] = a0Im - a2Im;
+        re[j + 1] = a1Re + a3Im;
+        im[j + 1] = a1Im - a3Re;
+        re[j + 3] = a1Re - a3Im;
+        im[j + 3] = a1Im + a3Re;
+    }
+}
+
+// samples outside [0, len) are zero
+void load(const int16_t* x, size_t len, double* buffer, size_t bufferLen) {
+    std::copy(x, x + len, buffer);
+    std::fill(buffer + len, buffer + bufferLen, 0.0);
+}
+
+// the exact result is an integer; wrap it around like the 16 bit multiply-adds of the direct kernels do
+int16_t toInt16(double value) {
+    return static_cast<int16_t>(static_cast<uint16_t>(std::llrint(value)));
+}
+
+size_t fftLenFor(size_t hLen) {
+    const size_t overlap = hLen - 1;
+    size_t bestLen = 0;
+    double bestCost = std::numeric_limits<double>::max();
+    size_t stages = 2;
+    for (size_t len = 4; len <= maxFftLen or bestLen == 0; len *= 2, ++stages) {
+        if (len <= overlap) {
+            continue;
+        }
+        const double cost = static_cast<double>(len * stages) / (len - overlap);
+        if (cost < bestCost) {
+            bestLen = len;
+            bestCost = cost;
+        }
+    }
+    return bestLen;
+}
+
+// FNV-1a of the weights, to find the convolver of a filter without comparing against every cached one
+uint64_t filterHash(const int16_t* h, size_t hLen) {
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < hLen; ++i) {
+        hash = (hash ^ static_cast<uint16_t>(h[i])) * 1099511628211u;
+    }
+    return hash;
+}
+
+size_t nextPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) {
+        power *= 2;
+    }
+    return power;
+}
+
+// fastest of a few runs, so that a page fault or an interrupt does not decide the method
+template<typename Function>
+uint64_t measureCycles(Function function) {
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    uint64_t total = 0;
+    for (size_t run = 0; run < 100 and (run < 3 or total < 10000000); ++run) {
+        const uint64_t startTicks = __rdtsc();
+        function();
+        const uint64_t cycles = __rdtsc() - startTicks;
+        best = std::min(best, cycles);
+        total += cycles;
+    }
+    return best;
+}
+}
+
+Fft::Fft(size_t len) : len(len), butterflies(cpu::supports(cpu::Isa::avx2) ? butterfliesAvx2 : conv::butterflies) {
+    size_t bits = 0;
+    while ((size_t{1} << bits) < len) {
+        ++bits;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        size_t reversed = 0;
+        for (size_t bit = 0; bit < bits; ++bit) {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+        if (i < reversed) {
+            swaps.emplace_back(i, reversed);
+        }
+    }
+    for (size_t m = 4; m < len; m *= 2) {
+        for (size_t k = 0; k < m; ++k) {
+            twiddleRe.push_back(std::cos(M_PI * k / m));
+            twiddleIm.push_back(-std::sin(M_PI * k / m));
+        }
+    }
+}
+
+void Fft::forward(double* re, double* im) const {
+    for (const auto& swap : swaps) {
+        std::swap(re[swap.first], re[swap.second]);
+        std::swap(im[swap.first], im[swap.second]);
+    }
+    radix4(re, im, len);
+    for (size_t m = 4; m < len; m *= 2) {
+        butterflies(re, im, len, m, &twiddleRe[m - 4], &twiddleIm[m - 4]);
+    }
+}
+
+FftConvolver::FftConvolver(const int16_t* h, size_t hLen, size_t fftLen)
+    : h(h, h + hLen), hLen(hLen), fft(fftLen ? fftLen : fftLenFor(hLen)), spectrumRe(fft.size()), spectrumIm(fft.size()) {
+    for (size_t i = 0; i < hLen; ++i) {
+        spectrumRe[i] = h[i] / static_cast<double>(fft.size());
+    }
+    fft.forward(spectrumRe.data(), spectrumIm.data());
+}
+
+int16_t* FftConvolver::convolve(const int16_t* x, int16_t* y, size_t yLen) const {
+    const size_t len = fft.size();
+    const size_t overlap = hLen - 1;
+    const size_t block = blockLen();
+    // per thread, so that short calls do not pay for allocating them
+    thread_local std::vector<double> reBuffer;
+    thread_local std::vector<double> imBuffer;
+    reBuffer.resize(std::max(reBuffer.size(), len));
+    imBuffer.resize(std::max(imBuffer.size(), len));
+    double* re = reBuffer.data();
+    double* im = imBuffer.data();
+    for (size_t t = 0; t < yLen; t += 2 * block) {
+        // first block as the real part, second one as the imaginary part: the filter is real, so they do not mix
+        const size_t firstLen = std::min(block, yLen - t);
+        const size_t secondLen = t + block < yLen ? std::min(block, yLen - t - block) : 0;
+        load(&x[t], overlap + firstLen, re, len);
+        if (secondLen) {
+            load(&x[t + block], overlap + secondLen, im, len);
+        }
+        else {
+            std::fill(im, im + len, 0.0);
+        }
+
+        fft.forward(re, im);
+        for (size_t k = 0; k < len; ++k) {
+            const double productRe = re[k] * spectrumRe[k] - im[k] * spectrumIm[k];
+            const double productIm = re[k] * spectrumIm[k] + im[k] * spectrumRe[k];
+            re[k] = productRe;
+            im[k] = productIm;
+        }
+        fft.inverse(re, im);
+
+        // the first hLen - 1 results of each block are wrapped around from its end
+        for (size_t j = 0; j < firstLen; ++j) {
+            y[t + j] = toInt16(re[overlap + j]);
+        }
+        for (size_t j = 0; j < secondLen; ++j) {
+            y[t + block + j] = toInt16(im[overlap + j]);
+        }
+    }
+    return y;
+}
+
+bool FftConvolver::hasFilter(const int16_t* h, size_t hLen) const {
+    return hLen == this->hLen and std::equal(h, h + hLen, this->h.begin());
+}
+
+Method Planner::choose(size_t hLen, size_t yLen, Symmetry symmetry) {
+    const size_t blockLen = std::min(nextPowerOfTwo(yLen), maxMeasuredLen);
+    const auto key = std::make_tuple(hLen, blockLen, symmetry);
+    const auto found = methods.find(key);
+    if (found != methods.end()) {
+        return found->second;
+    }
+
+    // the timings depend on the symmetry of the filter but not on the values otherwise; h[0] = 4 breaks any symmetry
+    // of the others, which stay within [-3, 3]
+    std::vector<int16_t> h(hLen);
+    for (size_t i = 0; i < hLen; ++i) {
+        h[i] = static_cast<int16_t>(i % 7) - 3;
+    }
+    h[0] = 4;
+    for (size_t i = 0; i < hLen / 2 and symmetry != Symmetry::none; ++i) {
+        h[(hLen - 1) - i] = symmetry == Symmetry::symmetric ? h[i] : -h[i];
+    }
+    if (hLen % 2 == 1 and symmetry == Symmetry::antisymmetric) {
+        h[hLen / 2] = 0;
+    }
+    const Padding padding = convolvePadding(hLen);
+    std::vector<int16_t> x(padding.inputBefore + blockLen + padding.inputAfter);
+    for (size_t t = 0; t < blockLen; ++t) {
+        x[padding.inputBefore + t] = static_cast<int16_t>(t * 31 % 2001) - 1000;
+    }
+    std::vector<int16_t> y(blockLen + padding.outputAfter);
+
+    const uint64_t directCycles = measureCycles([&] {
+        conv::convolve(x.data(), h.data(), hLen, y.data(), blockLen);
+    });
+    const FftConvolver fftConvolver(h.data(), hLen);
+    const uint64_t fftCycles = measureCycles([&] {
+        fftConvolver.convolve(x.data(), y.data(), blockLen);
+    });
+
+    const Method method = fftCycles < directCycles ? Method::fft : Method::direct;
+    methods.emplace(key, method);
+    return method;
+}
+
+int16_t* Planner::convolve(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    if (choose(hLen, yLen, symmetry(h, hLen)) == Method::direct) {
+        return conv::convolve(x, h, hLen, y, yLen);
+    }
+    const auto key = std::make_pair(hLen, filterHash(h, hLen));
+    auto found = fftConvolvers.find(key);
+    if (found == fftConvolvers.end()) {
+        if (fftConvolvers.size() == maxCachedFilters) {
+            fftConvolvers.clear();
+        }
+        found = fftConvolvers.emplace(key, nullptr).first;
+    }
+    // a hash collision replaces the other filter's convolver
+    if (not found->second or not found->second->hasFilter(h, hLen)) {
+        found->second.reset(new FftConvolver(h, hLen));
+    }
+    return found->second->convolve(x, y, yLen);
+}
+}
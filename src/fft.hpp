@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "convolution.hpp"
+
+namespace conv {
+
+// In-place complex FFT of a power-of-two length (at least 4) on split real/imaginary arrays. The first two radix-2
+// stages are done as one radix-4 pass, the rest with 4 butterflies per AVX2 register when the CPU supports it.
+class Fft {
+public:
+    explicit Fft(size_t len);
+
+    size_t size() const { return len; }
+    void forward(double* re, double* im) const;
+    // unscaled: inverse(forward(x)) == size() * x
+    void inverse(double* re, double* im) const { forward(im, re); }
+
+private:
+    size_t len;
+    std::vector<std::pair<uint32_t, uint32_t>> swaps; // bit-reversal permutation
+    std::vector<double> twiddleRe;                    // stage with half-length m uses twiddle[m - 4 + k], k < m
+    std::vector<double> twiddleIm;
+    void (*butterflies)(double* re, double* im, size_t len, size_t m, const double* twiddleRe, const double* twiddleIm);
+};
+
+// Overlap-save convolution through the FFT for long filters: O(log fftLen) work per output instead of O(hLen). The
+// filter spectrum is calculated once, and two blocks of input share each transform as the real and imaginary parts.
+// The results are rounded back to the same wrapped-around int16 values as the direct kernels produce.
+class FftConvolver {
+public:
+    // fftLen 0 picks the length with the least work per output
+    FftConvolver(const int16_t* h, size_t hLen, size_t fftLen = 0);
+
+    // same as conv::convolve(), but reads only the hLen - 1 + yLen inputs and writes only the yLen outputs needed, so
+    // no padding is needed after the input; can be called from several threads at once
+    int16_t* convolve(const int16_t* x, int16_t* y, size_t yLen) const;
+
+    size_t fftLen() const { return fft.size(); }
+    size_t blockLen() const { return fft.size() - (hLen - 1); }
+    bool hasFilter(const int16_t* h, size_t hLen) const;
+
+private:
+    std::vector<int16_t> h;
+    size_t hLen;
+    Fft fft;
+    std::vector<double> spectrumRe; // scaled by 1 / fftLen, so that inverse() gives the result directly
+    std::vector<double> spectrumIm;
+};
+
+enum class Method {
+    direct,
+    fft,
+};
+
+// Chooses between conv::convolve() and FftConvolver by timing both the first time a filter length, block size (rounded
+// up to a power of two) and symmetry is seen; convolve() folds symmetric and antisymmetric filters, which moves the
+// crossover. Not thread-safe; use one per thread.
+class Planner {
+public:
+    Method choose(size_t hLen, size_t yLen, Symmetry symmetry);
+
+    // needs the same padding as conv::convolve(); the FFT convolvers of the latest few filters are kept for the next
+    // calls
+    int16_t* convolve(const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen);
+
+private:
+    std::map<std::tuple<size_t, size_t, Symmetry>, Method> methods;
+    std::map<std::pair<size_t, uint64_t>, std::unique_ptr<FftConvolver>> fftConvolvers; // by length and hash of the weights
+};
+}
@@ -1,11 +1,19 @@
 #include <iostream>
 #include <immintrin.h>
 #include <string.h>
+#include <memory>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "batch.hpp"
+#include "convolution.hpp"
+#include "cpu.hpp"
 #include "data.hpp"
-
-namespace data {
-int16_t y[data::yLen + 16]{};
-}
+#include "fft.hpp"
+#include "parallel.hpp"
+#include "plane.hpp"
+#include "resample.hpp"
+#include "stream.hpp"
 
 // h[0] * x[4 + t] +
 // h[1] * x[3 + t] +
@@ -22,7 +30,7 @@ int16_t* naive(const int16_t* __restrict__ x, int16_t* __restrict__ y, size_t yL
     return y;
 }
 
-int16_t* dumbSse(const int16_t* x, int16_t* y, size_t yLen) {
+TARGET_SSE41 int16_t* dumbSse(const int16_t* x, int16_t* y, size_t yLen) {
     const __m128i mFilter = _mm_set_epi16(0, 0, 0, data::h[4], data::h[3], data::h[2], data::h[1], data::h[0]);
     for (auto t = 0; t < yLen; ++t) {
         __m128i input = _mm_set_epi16(0, 0, 0, x[t], x[t + 1], x[t + 2], x[t + 3], x[t + 4]);
@@ -34,7 +42,7 @@ int16_t* dumbSse(const int16_t* x, int16_t* y, size_t yLen) {
     return y;
 }
 
-int16_t* sse(const int16_t* x, int16_t* y, size_t yLen) {
+TARGET_SSE41 int16_t* sse(const int16_t* x, int16_t* y, size_t yLen) {
     // filter has to be zero-padded and should be reversed: however, our filter is symmetrical,
     // so the reverse is not really needed
     const __m128i mFilter = _mm_loadu_si128((__m128i*)&data::h[0]);
@@ -53,7 +61,7 @@ int16_t* sse(const int16_t* x, int16_t* y, size_t yLen) {
 // filter[0] * x[t + 2] + filter[1] * x[t + 3] + ... + filter[4] * x[t + 6]
 // ...
 // filter[0] * x[t + 7] + filter[1] * x[t + 8] + ... + filter[4] * x[t + 11]
-int16_t* smartSse(const int16_t* x, int16_t* y, size_t yLen) {
+TARGET_SSE41 int16_t* smartSse(const int16_t* x, int16_t* y, size_t yLen) {
     __m128i mFilter[data::hLen];
     // should revert the filter
     for (auto i = 0; i < data::hLen; ++i) {
@@ -74,7 +82,7 @@ int16_t* smartSse(const int16_t* x, int16_t* y, size_t yLen) {
     return y;
 }
 
-int16_t* smartAvx2(const int16_t* __restrict__ x, int16_t* __restrict__ y, size_t yLen) {
+TARGET_AVX2 int16_t* smartAvx2(const int16_t* __restrict__ x, int16_t* __restrict__ y, size_t yLen) {
     __m256i mFilter[data::hLen];
     for (auto i = 0; i < data::hLen; ++i) {
         mFilter[i] = _mm256_set1_epi16(data::h[i]);
@@ -93,74 +101,398 @@ int16_t* smartAvx2(const int16_t* __restrict__ x, int16_t* __restrict__ y, size_
     return y;
 }
 
-bool validate(int16_t* y, size_t yLen) {
+int16_t* convolve(const int16_t* x, int16_t* y, size_t yLen) {
+    return conv::convolve(x, data::h, data::hLen, y, yLen);
+}
+
+int16_t* fft(const int16_t* x, int16_t* y, size_t yLen) {
+    static const conv::FftConvolver convolver(data::h, data::hLen);
+    return convolver.convolve(x, y, yLen);
+}
+
+bool validate(const int16_t* y, const int16_t* yExpected, size_t yLen) {
     for (auto t = 0; t < yLen; ++t) {
-        if (data::yExpected[t] != y[t]) {
-            std::cerr << "Error at index " << t << ", got " << static_cast<int>(y[t]) << ", expected " << static_cast<int>(data::yExpected[t]) << std::endl;
+        if (yExpected[t] != y[t]) {
+            std::cerr << "Error at index " << t << ", got " << static_cast<int>(y[t]) << ", expected " << static_cast<int>(yExpected[t]) << std::endl;
             return false;
         }
     }
     return true;
 }
 
+// a quick average; see simd-bench for medians, percentiles and hardware counters
+template<typename Run>
+void printCycles(Run run, const std::string& detail) {
+    uint64_t startTicks = __rdtsc();
+    uint64_t durationCycles = 0;
+    uint64_t runCount = 0;
+    do
+    {
+        run();
+        ++runCount;
+        durationCycles = __rdtsc() - startTicks;
+    } while (durationCycles < 1000000000);
+
+    std::cout << "Cycles per convolution (averaged over " << runCount << " runs): " << durationCycles/(double)runCount << detail << std::endl;
+}
+
+// convolves channelCount channels of xLen samples with data::h in one call, with conv::convolveBatch() or always
+// transposed; the channels are consecutive pieces of the repeated data::x
+int batch(bool transposed, size_t channelCount, size_t xLen, bool shouldValidate) {
+    const conv::Padding padding = conv::batchPadding(data::hLen);
+    const size_t yLen = xLen + data::hLen - 1;
+    std::vector<std::vector<int16_t>> x(channelCount, std::vector<int16_t>(padding.inputBefore + xLen + padding.inputAfter));
+    std::vector<std::vector<int16_t>> y(channelCount, std::vector<int16_t>(yLen + padding.outputAfter));
+    std::vector<const int16_t*> xChannels;
+    std::vector<int16_t*> yChannels;
+    for (size_t c = 0; c < channelCount; ++c) {
+        for (size_t t = 0; t < xLen; ++t) {
+            x[c][padding.inputBefore + t] = data::x[data::hLen - 1 + (c * xLen + t) % data::xLen];
+        }
+        xChannels.push_back(x[c].data());
+        yChannels.push_back(y[c].data());
+    }
+
+    auto run = [&] {
+        if (transposed) {
+            conv::convolveTransposed(xChannels.data(), channelCount, data::h, data::hLen, yChannels.data(), yLen);
+        }
+        else {
+            conv::convolveBatch(xChannels.data(), channelCount, data::h, data::hLen, yChannels.data(), yLen);
+        }
+    };
+
+    run();
+    if (shouldValidate) {
+        std::vector<int16_t> yReference(yLen);
+        for (size_t c = 0; c < channelCount; ++c) {
+            conv::naive(x[c].data(), data::h, data::hLen, yReference.data(), yLen);
+            if (not validate(y[c].data(), yReference.data(), yLen)) {
+                std::cerr << "in channel " << c << std::endl;
+                return -1;
+            }
+        }
+    }
+
+    printCycles(run, " (" + std::to_string(channelCount) + " channels)");
+    return 0;
+}
+
+// decimates or interpolates xLen samples of the repeated data::x with data::h by factor
+int resample(bool interpolating, size_t factor, size_t xLen, bool shouldValidate) {
+    // outputs of the full convolution; decimation keeps every factor-th of them
+    const size_t fullLen = (interpolating ? xLen * factor : xLen) + data::hLen - 1;
+    const size_t yLen = interpolating ? fullLen : (fullLen + factor - 1) / factor;
+    // the input starts after the zeros and is followed by more of them, up to the last sample read
+    const size_t zeros = interpolating ? conv::phaseLen(data::hLen, factor) - 1 : data::hLen - 1;
+    const size_t readLen = interpolating ? zeros + (yLen - 1) / factor + 1 : (yLen - 1) * factor + data::hLen;
+    std::vector<int16_t> x(std::max(zeros + xLen, readLen));
+    std::vector<int16_t> y(yLen);
+    for (size_t t = 0; t < xLen; ++t) {
+        x[zeros + t] = data::x[data::hLen - 1 + t % data::xLen];
+    }
+
+    auto run = [&] {
+        if (interpolating) {
+            conv::interpolate(x.data(), data::h, data::hLen, factor, y.data(), yLen);
+        }
+        else {
+            conv::decimate(x.data(), data::h, data::hLen, factor, y.data(), yLen);
+        }
+    };
+
+    run();
+    if (shouldValidate) {
+        // the full convolution of the input, upsampled with zeros for interpolation
+        const size_t stuffedLen = interpolating ? xLen * factor : xLen;
+        std::vector<int16_t> stuffed(data::hLen - 1 + stuffedLen + data::hLen - 1);
+        for (size_t t = 0; t < xLen; ++t) {
+            stuffed[data::hLen - 1 + (interpolating ? t * factor : t)] = x[zeros + t];
+        }
+        std::vector<int16_t> full(fullLen);
+        conv::naive(stuffed.data(), data::h, data::hLen, full.data(), fullLen);
+        std::vector<int16_t> yReference(yLen);
+        for (size_t k = 0; k < yLen; ++k) {
+            yReference[k] = full[interpolating ? k : k * factor];
+        }
+        if (not validate(y.data(), yReference.data(), yLen)) {
+            return -1;
+        }
+    }
+
+    printCycles(run, " (factor " + std::to_string(factor) + ")");
+    return 0;
+}
+
+// the modes that do not fit targetFunction
+enum class Mode {
+    none,
+    batch,
+    transposed,
+    decimate,
+    interpolate,
+    plane,
+    separable,
+    direct
+};
+
+// convolves a width x height plane, filled from the repeated data::x, with the kernel h[i] * h[j]: with
+// conv::convolvePlane(), which separates it, or explicitly separated or direct
+int plane(Mode mode, size_t width, size_t height, bool shouldValidate) {
+    constexpr size_t kernelSize = data::hLen;
+    int16_t kernel[kernelSize * kernelSize];
+    for (size_t i = 0; i < kernelSize; ++i) {
+        for (size_t j = 0; j < kernelSize; ++j) {
+            kernel[i * kernelSize + j] = data::h[i] * data::h[j];
+        }
+    }
+    const size_t xStride = width + kernelSize - 1;
+    std::vector<int16_t> x((height + kernelSize - 1) * xStride);
+    std::vector<int16_t> y(height * width);
+    for (size_t t = 0; t < x.size(); ++t) {
+        x[t] = data::x[data::hLen - 1 + t % data::xLen];
+    }
+
+    auto run = [&] {
+        if (mode == Mode::separable) {
+            conv::convolveSeparable(x.data(), xStride, data::h, kernelSize, data::h, kernelSize, y.data(), width, width, height);
+        }
+        else if (mode == Mode::direct) {
+            conv::convolveDirect(x.data(), xStride, kernel, kernelSize, kernelSize, y.data(), width, width, height);
+        }
+        else {
+            conv::convolvePlane(x.data(), xStride, kernel, kernelSize, kernelSize, y.data(), width, width, height);
+        }
+    };
+
+    run();
+    if (shouldValidate) {
+        std::vector<int16_t> yReference(height * width);
+        for (size_t r = 0; r < height; ++r) {
+            for (size_t c = 0; c < width; ++c) {
+                int16_t sum = 0;
+                for (size_t i = 0; i < kernelSize; ++i) {
+                    for (size_t j = 0; j < kernelSize; ++j) {
+                        sum += kernel[i * kernelSize + j] * x[(r + kernelSize - 1 - i) * xStride + c + kernelSize - 1 - j];
+                    }
+                }
+                yReference[r * width + c] = sum;
+            }
+        }
+        if (not validate(y.data(), yReference.data(), height * width)) {
+            return -1;
+        }
+    }
+
+    printCycles(run, " (" + std::to_string(width) + " x " + std::to_string(height) + ")");
+    return 0;
+}
+
+// convolves raw int16 samples from a file or stdin with data::h and writes them to stdout
+int stream(const std::string& path) {
+    const int inFd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (inFd < 0) {
+        std::cerr << "cannot open " << path << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    const bool ok = conv::convolveStream(inFd, STDOUT_FILENO, data::h, data::hLen);
+    if (not ok) {
+        std::cerr << "streaming failed: " << strerror(errno) << std::endl;
+    }
+    if (inFd != STDIN_FILENO) {
+        close(inFd);
+    }
+    return ok ? 0 : -1;
+}
+
 int main(int argc, char** argv) {
     int16_t* (*targetFunction)(const int16_t*, int16_t*, size_t) = nullptr;
 
+    cpu::Isa requiredIsa = cpu::Isa::generic;
     bool shouldValidate = false;
+    size_t threadCount = 0; // no thread pool
+    size_t xLen = data::xLen;
+    Mode mode = Mode::none;
+    size_t channelCount = 64;
+    size_t factor = 2;
+    size_t width = 1920;
+    size_t height = 1080;
     if (argc > 1)
     {
         std::string firstArg{argv[1]};
 
+        if (firstArg == "--stream" and argc <= 3) {
+            return stream(argc > 2 ? argv[2] : "-");
+        }
+
         if (firstArg == "--naive") {
             targetFunction = naive;
         }
         else if (firstArg == "--dumbSse") {
             targetFunction = dumbSse;
+            requiredIsa = cpu::Isa::sse41;
         }
         else if (firstArg == "--sse") {
             targetFunction = sse;
+            requiredIsa = cpu::Isa::sse41;
         }
         else if (firstArg == "--smartSse") {
             targetFunction = smartSse;
+            requiredIsa = cpu::Isa::sse41;
         }
         else if (firstArg == "--smartAvx2") {
             targetFunction = smartAvx2;
+            requiredIsa = cpu::Isa::avx2;
+        }
+        else if (firstArg == "--convolve") {
+            targetFunction = convolve;
+        }
+        else if (firstArg == "--fft") {
+            targetFunction = fft;
+        }
+        else if (firstArg == "--batch") {
+            mode = Mode::batch;
+        }
+        else if (firstArg == "--transposed") {
+            mode = Mode::transposed;
+        }
+        else if (firstArg == "--decimate") {
+            mode = Mode::decimate;
+        }
+        else if (firstArg == "--interpolate") {
+            mode = Mode::interpolate;
+        }
+        else if (firstArg == "--plane") {
+            mode = Mode::plane;
+        }
+        else if (firstArg == "--separable") {
+            mode = Mode::separable;
+        }
+        else if (firstArg == "--direct") {
+            mode = Mode::direct;
         }
 
-        if (argc > 2) {
-            if (std::string{argv[2]} == "--validate") {
+        for (int arg = 2; arg < argc; ++arg) {
+            const std::string option{argv[arg]};
+            if (option == "--validate") {
                 shouldValidate = true;
             }
+            else if (option == "--threads" and arg + 1 < argc) {
+                threadCount = strtoul(argv[++arg], nullptr, 10);
+                if (threadCount == 0) {
+                    targetFunction = nullptr;
+                    mode = Mode::none;
+                }
+            }
+            else if (option == "--length" and arg + 1 < argc) {
+                xLen = strtoul(argv[++arg], nullptr, 10);
+                if (xLen == 0) {
+                    targetFunction = nullptr;
+                    mode = Mode::none;
+                }
+            }
+            else if (option == "--channels" and (mode == Mode::batch or mode == Mode::transposed) and arg + 1 < argc) {
+                channelCount = strtoul(argv[++arg], nullptr, 10);
+                if (channelCount == 0) {
+                    mode = Mode::none;
+                }
+            }
+            else if (option == "--factor" and (mode == Mode::decimate or mode == Mode::interpolate) and arg + 1 < argc) {
+                factor = strtoul(argv[++arg], nullptr, 10);
+                if (factor == 0) {
+                    mode = Mode::none;
+                }
+            }
+            else if ((option == "--width" or option == "--height") and (mode == Mode::plane or mode == Mode::separable or mode == Mode::direct) and arg + 1 < argc) {
+                size_t& size = option == "--width" ? width : height;
+                size = strtoul(argv[++arg], nullptr, 10);
+                if (size == 0) {
+                    mode = Mode::none;
+                }
+            }
             else {
                 targetFunction = nullptr;
+                mode = Mode::none;
             }
         }
     }
 
+    if (threadCount == 0) {
+        switch (mode) {
+            case Mode::none: break;
+            case Mode::batch: return batch(false, channelCount, xLen, shouldValidate);
+            case Mode::transposed: return batch(true, channelCount, xLen, shouldValidate);
+            case Mode::decimate: return resample(false, factor, xLen, shouldValidate);
+            case Mode::interpolate: return resample(true, factor, xLen, shouldValidate);
+            case Mode::plane:
+            case Mode::separable:
+            case Mode::direct: return plane(mode, width, height, shouldValidate);
+        }
+    }
+
     if (not targetFunction) {
-        std::cerr << "usage: " << argv[0] << " --naive|--dumbSse|--sse|--smartSse|--smartAvx2 [--validate]" << std::endl;
+        std::cerr << "usage: " << argv[0] << " --naive|--dumbSse|--sse|--smartSse|--smartAvx2|--convolve|--fft [--validate] [--threads N] [--length N]" << std::endl;
+        std::cerr << "       " << argv[0] << " --batch|--transposed [--validate] [--length N] [--channels N]" << std::endl;
+        std::cerr << "       " << argv[0] << " --decimate|--interpolate [--validate] [--length N] [--factor N]" << std::endl;
+        std::cerr << "       " << argv[0] << " --plane|--separable|--direct [--validate] [--width N] [--height N]" << std::endl;
+        std::cerr << "       " << argv[0] << " --stream [FILE|-] > OUTPUT" << std::endl;
         return -1;
     }
 
-    uint64_t startTicks = __rdtsc();
-    uint64_t durationCycles = 0;
-    uint64_t runCount = 0;
-    do
-    {
-        auto* result = targetFunction(&data::x[0], &data::y[0], data::yLen);
-        if (shouldValidate and not validate(result, data::yLen)) {
-            return -1;
+    if (not cpu::supports(requiredIsa)) {
+        std::cerr << "this CPU does not support " << cpu::name(requiredIsa) << " (best available: " << cpu::name(cpu::detect()) << ")" << std::endl;
+        return -1;
+    }
+
+    // the tiles run the same kernels on parts of the data
+    std::unique_ptr<conv::ThreadPool> pool;
+    if (threadCount > 0) {
+        pool.reset(new conv::ThreadPool(threadCount));
+    }
+    auto allocate = [&pool](size_t len) {
+        std::unique_ptr<int16_t[]> buffer(new int16_t[len]);
+        if (pool) {
+            conv::firstTouch(*pool, buffer.get(), len);
         }
-        ++runCount;
-        durationCycles = __rdtsc() - startTicks;
-    } while (durationCycles < 1000000000);
+        else {
+            memset(buffer.get(), 0, len * sizeof(int16_t));
+        }
+        return buffer;
+    };
 
-    std::cout << "Cycles per convolution (averaged over " << runCount << " runs): " << durationCycles/(double)runCount;
-    if (shouldValidate) {
-        std::cout << " (incl. validation)";
+    // the widest kernel determines how much zero-padding is needed around the data; longer inputs repeat data::x
+    const conv::Padding padding = conv::padding(conv::avx2Lanes, data::hLen);
+    const size_t yLen = xLen + data::hLen - 1;
+    std::unique_ptr<int16_t[]> x = allocate(padding.inputBefore + xLen + padding.inputAfter);
+    std::unique_ptr<int16_t[]> y = allocate(yLen + padding.outputAfter);
+    for (size_t t = 0; t < xLen; t += data::xLen) {
+        memcpy(&x[padding.inputBefore + t], &data::x[data::hLen - 1], std::min(data::xLen, xLen - t) * sizeof(int16_t));
+    }
+
+    const int16_t* yExpected = data::yExpected;
+    std::vector<int16_t> yReference;
+    if (shouldValidate and xLen != data::xLen) {
+        yReference.resize(yLen);
+        yExpected = conv::naive(&x[0], data::h, data::hLen, &yReference[0], yLen);
+    }
+
+    auto run = [&] {
+        if (pool) {
+            conv::forEachTile(*pool, yLen, [&](size_t begin, size_t len) {
+                targetFunction(&x[begin], &y[begin], len);
+            });
+            return &y[0];
+        }
+        return targetFunction(&x[0], &y[0], yLen);
+    };
+
+    // the first run warms up the caches and is the one validated, so validation does not count in the timing
+    int16_t* result = run();
+    if (shouldValidate and not validate(result, yExpected, yLen)) {
+        return -1;
     }
-    std::cout << std::endl;
 
+    printCycles(run, pool ? " (" + std::to_string(pool->size()) + " threads)" : "");
     return 0;
 }
 
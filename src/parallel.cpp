@@ -0,0 +1,134 @@
+#include "parallel.hpp"
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include "convolution.hpp"
+
+namespace conv {
+
+namespace {
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+}
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    const std::vector<int> cpus = allowedCpus();
+    if (threadCount == 0) {
+        threadCount = std::max<size_t>(cpus.size(), 1);
+    }
+    ranges.reset(new Range[threadCount]);
+    for (size_t worker = 0; worker < threadCount; ++worker) {
+        workers.emplace_back(&ThreadPool::work, this, worker);
+        if (not cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[worker % cpus.size()], &set);
+            pthread_setaffinity_np(workers.back().native_handle(), sizeof(set), &set);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(size_t taskCount, const std::function<void(size_t)>& task) {
+    const size_t workerCount = workers.size();
+    for (size_t worker = 0; worker < workerCount; ++worker) {
+        std::lock_guard<std::mutex> lock(ranges[worker].mutex);
+        ranges[worker].begin = taskCount * worker / workerCount;
+        ranges[worker].end = taskCount * (worker + 1) / workerCount;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    this->task = &task;
+    busy = workerCount;
+    ++generation;
+    wake.notify_all();
+    done.wait(lock, [this] { return busy == 0; });
+    this->task = nullptr;
+}
+
+void ThreadPool::work(size_t worker) {
+    uint64_t seenGeneration = 0;
+    while (true) {
+        const std::function<void(size_t)>* current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping or generation != seenGeneration; });
+            if (stopping) {
+                return;
+            }
+            seenGeneration = generation;
+            current = task;
+        }
+        size_t index;
+        while (next(worker, index)) {
+            (*current)(index);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0) {
+            done.notify_one();
+        }
+    }
+}
+
+bool ThreadPool::next(size_t worker, size_t& task) {
+    {
+        Range& own = ranges[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin < own.end) {
+            task = own.begin++;
+            return true;
+        }
+    }
+    // steal from the far end, so that the victim keeps working through its range in order
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Range& victim = ranges[(worker + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.begin < victim.end) {
+            task = --victim.end;
+            return true;
+        }
+    }
+    return false;
+}
+
+void forEachTile(ThreadPool& pool, size_t yLen, const std::function<void(size_t begin, size_t len)>& tile) {
+    const size_t tileCount = (yLen + tileLen - 1) / tileLen;
+    pool.run(tileCount, [&](size_t index) {
+        const size_t begin = index * tileLen;
+        tile(begin, std::min(tileLen, yLen - begin));
+    });
+}
+
+void firstTouch(ThreadPool& pool, int16_t* buffer, size_t len) {
+    forEachTile(pool, len, [&](size_t begin, size_t len) {
+        memset(&buffer[begin], 0, len * sizeof(int16_t));
+    });
+}
+
+int16_t* convolveParallel(ThreadPool& pool, const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen) {
+    forEachTile(pool, yLen, [&](size_t begin, size_t len) {
+        convolve(&x[begin], h, hLen, &y[begin], len);
+    });
+    return y;
+}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace conv {
+
+// Persistent workers, each pinned to its own core. run() gives every worker a contiguous range of the tasks; a
+// worker that runs out of its own takes tasks from the end of the others' ranges.
+class ThreadPool {
+public:
+    // threadCount 0 means one worker per available core
+    explicit ThreadPool(size_t threadCount);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // calls task(i) for every i in [0, taskCount) and waits until they are all done
+    void run(size_t taskCount, const std::function<void(size_t)>& task);
+
+private:
+    struct Range {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void work(size_t worker);
+    bool next(size_t worker, size_t& task);
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Range[]> ranges;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* task = nullptr;
+    uint64_t generation = 0;
+    size_t busy = 0;
+    bool stopping = false;
+};
+
+// Outputs per tile: the tile's input (plus its hLen - 1 sample halo) and output fit in L2. This is a multiple of every
+// kernel's lanes, so the rounds of one tile never write into the next one.
+constexpr size_t tileLen = 1 << 14;
+
+// calls tile(begin, len) for consecutive tiles of [0, yLen) in the pool
+void forEachTile(ThreadPool& pool, size_t yLen, const std::function<void(size_t begin, size_t len)>& tile);
+
+// Zero-fills a newly allocated buffer tile by tile in the pool. With the default first-touch policy the pages end up
+// on the NUMA node of the worker that starts with the same tiles in forEachTile().
+void firstTouch(ThreadPool& pool, int16_t* buffer, size_t len);
+
+// conv::convolve() split into tiles; x and y need the same padding as for conv::convolve()
+int16_t* convolveParallel(ThreadPool& pool, const int16_t* x, const int16_t* h, size_t hLen, int16_t* y, size_t yLen);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace perf {
+
+enum Counter {
+    cycles,
+    instructions,
+    l1dMisses,
+    llcMisses,
+    counterCount,
+};
+
+const char* name(Counter counter);
+
+// Hardware counters of the calling thread (user space only) through perf_event_open. Counters that the kernel or the
+// CPU does not provide, e.g. with a strict perf_event_paranoid or inside a VM, are simply not available().
+class Counters {
+public:
+    Counters();
+    ~Counters();
+    Counters(const Counters&) = delete;
+    Counters& operator=(const Counters&) = delete;
+
+    bool available(Counter counter) const { return fds[counter] >= 0; }
+
+    void start();
+    void stop();
+    // counted between start() and stop(), scaled up if the kernel had to multiplex the counters
+    uint64_t value(Counter counter) const;
+
+private:
+    int fds[counterCount];
+};
+}
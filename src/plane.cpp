@@ -0,0 +1,211 @@
+#include "plane.hpp"
+#include <algorithm>
+#include <immintrin.h>
+#include <numeric>
+#include <vector>
+
+namespace conv {
+
+namespace {
+// strips as wide as the window of intermediate rows allows, since narrow strips starved the prefetchers in simd-bench
+// --kernels plane
+constexpr size_t windowSamples = 1 << 17;
+constexpr size_t minTileWidth = 1024;
+constexpr size_t blockRegisters = 4;
+// direct 2D convolution up to this many taps per dimension, where it beat separable in simd-bench --kernels
+// separable,direct
+constexpr size_t maxDirectTaps = 4;
+
+// y[c] += weights[0] * row[count - 1 + c] + ... + weights[count - 1] * row[c] for c < len
+void accumulate(const int16_t* row, const int16_t* weights, size_t count, int16_t* y, size_t len) {
+    for (size_t c = 0; c < len; ++c) {
+        int16_t sum = 0;
+        for (size_t j = 0; j < count; ++j) {
+            sum += weights[j] * row[(count - 1) - j + c];
+        }
+        y[c] += sum;
+    }
+}
+
+// y[c] = v[0] * rows[0][c] + ... + v[kernelHeight - 1] * rows[kernelHeight - 1][c] for c in [begin, len)
+void verticalRow(const int16_t* const* rows, const int16_t* v, size_t kernelHeight, int16_t* y, size_t begin, size_t len) {
+    for (size_t c = begin; c < len; ++c) {
+        int16_t sum = 0;
+        for (size_t i = 0; i < kernelHeight; ++i) {
+            sum += v[i] * rows[i][c];
+        }
+        y[c] = sum;
+    }
+}
+
+template<size_t Registers>
+TARGET_AVX2 void verticalRoundAvx2(const int16_t* const* rows, const int16_t* v, size_t kernelHeight, int16_t* y, size_t c) {
+    __m256i sum[Registers];
+    for (size_t r = 0; r < Registers; ++r) {
+        sum[r] = _mm256_setzero_si256();
+    }
+    for (size_t i = 0; i < kernelHeight; ++i) {
+        const __m256i weight = _mm256_set1_epi16(v[i]);
+        for (size_t r = 0; r < Registers; ++r) {
+            __m256i input = _mm256_loadu_si256((const __m256i*)&rows[i][c + r * avx2Lanes]);
+            sum[r] = _mm256_add_epi16(sum[r], _mm256_mullo_epi16(input, weight));
+        }
+    }
+    for (size_t r = 0; r < Registers; ++r) {
+        _mm256_storeu_si256((__m256i*)&y[c + r * avx2Lanes], sum[r]);
+    }
+}
+
+TARGET_AVX2 void verticalRowAvx2(const int16_t* const* rows, const int16_t* v, size_t kernelHeight, int16_t* y, size_t len) {
+    size_t c = 0;
+    for (; c + blockRegisters * avx2Lanes <= len; c += blockRegisters * avx2Lanes) {
+        verticalRoundAvx2<blockRegisters>(rows, v, kernelHeight, y, c);
+    }
+    for (; c + avx2Lanes <= len; c += avx2Lanes) {
+        verticalRoundAvx2<1>(rows, v, kernelHeight, y, c);
+    }
+    verticalRow(rows, v, kernelHeight, y, c, len);
+}
+
+template<size_t Registers>
+TARGET_AVX2 void directRoundAvx2(const int16_t* const* rows, const int16_t* kernel, size_t kernelHeight, size_t kernelWidth, int16_t* y, size_t c) {
+    __m256i sum[Registers];
+    for (size_t r = 0; r < Registers; ++r) {
+        sum[r] = _mm256_setzero_si256();
+    }
+    for (size_t i = 0; i < kernelHeight; ++i) {
+        for (size_t j = 0; j < kernelWidth; ++j) {
+            const __m256i weight = _mm256_set1_epi16(kernel[i * kernelWidth + j]);
+            for (size_t r = 0; r < Registers; ++r) {
+                __m256i input = _mm256_loadu_si256((const __m256i*)&rows[i][(kernelWidth - 1) - j + c + r * avx2Lanes]);
+                sum[r] = _mm256_add_epi16(sum[r], _mm256_mullo_epi16(input, weight));
+            }
+        }
+    }
+    for (size_t r = 0; r < Registers; ++r) {
+        _mm256_storeu_si256((__m256i*)&y[c + r * avx2Lanes], sum[r]);
+    }
+}
+
+// one output row of convolveDirect() in columns [begin, len); rows[i] is the input row that kernel row i is multiplied with
+void directRow(const int16_t* const* rows, const int16_t* kernel, size_t kernelHeight, size_t kernelWidth, int16_t* y, size_t begin, size_t len) {
+    std::fill(&y[begin], &y[len], 0);
+    for (size_t i = 0; i < kernelHeight; ++i) {
+        accumulate(&rows[i][begin], &kernel[i * kernelWidth], kernelWidth, &y[begin], len - begin);
+    }
+}
+
+TARGET_AVX2 void directRowAvx2(const int16_t* const* rows, const int16_t* kernel, size_t kernelHeight, size_t kernelWidth, int16_t* y, size_t len) {
+    size_t c = 0;
+    for (; c + blockRegisters * avx2Lanes <= len; c += blockRegisters * avx2Lanes) {
+        directRoundAvx2<blockRegisters>(rows, kernel, kernelHeight, kernelWidth, y, c);
+    }
+    for (; c + avx2Lanes <= len; c += avx2Lanes) {
+        directRoundAvx2<1>(rows, kernel, kernelHeight, kernelWidth, y, c);
+    }
+    directRow(rows, kernel, kernelHeight, kernelWidth, y, c, len);
+}
+}
+
+bool separate(const int16_t* kernel, size_t kernelHeight, size_t kernelWidth, int16_t* vertical, int16_t* horizontal) {
+    // the first row with a weight, divided by the common divisor of its weights, is the horizontal filter; every row
+    // then has to be an integer multiple of it, because no smaller integer vector has the same direction
+    size_t first = 0;
+    while (first < kernelHeight and std::all_of(&kernel[first * kernelWidth], &kernel[(first + 1) * kernelWidth], [](int16_t w) { return w == 0; })) {
+        ++first;
+    }
+    if (first == kernelHeight) {
+        std::fill(vertical, vertical + kernelHeight, 0);
+        std::fill(horizontal, horizontal + kernelWidth, 0);
+        return true;
+    }
+    int divisor = 0;
+    size_t pivot = kernelWidth;
+    for (size_t j = 0; j < kernelWidth; ++j) {
+        const int w = kernel[first * kernelWidth + j];
+        divisor = std::gcd(divisor, w);
+        if (w != 0 and pivot == kernelWidth) {
+            pivot = j;
+        }
+    }
+    for (size_t j = 0; j < kernelWidth; ++j) {
+        horizontal[j] = kernel[first * kernelWidth + j] / divisor;
+    }
+    for (size_t i = 0; i < kernelHeight; ++i) {
+        const int scale = kernel[i * kernelWidth + pivot] / horizontal[pivot];
+        for (size_t j = 0; j < kernelWidth; ++j) {
+            if (kernel[i * kernelWidth + j] != scale * horizontal[j]) {
+                return false;
+            }
+        }
+        vertical[i] = scale;
+    }
+    return true;
+}
+
+int16_t* convolveSeparable(const int16_t* x, size_t xStride, const int16_t* vertical, size_t kernelHeight,
+    const int16_t* horizontal, size_t kernelWidth, int16_t* y, size_t yStride, size_t width, size_t height) {
+    const bool avx2 = cpu::supports(cpu::Isa::avx2);
+    // the window holds the horizontally filtered input rows [r, r + kernelHeight) of the strip for output row r, input
+    // row i in slot i % kernelHeight
+    const size_t tileWidth = std::min(width, std::max(minTileWidth, windowSamples / kernelHeight / avx2Lanes * avx2Lanes));
+    std::vector<int16_t> window(kernelHeight * tileWidth);
+    std::vector<const int16_t*> rows(kernelHeight);
+    for (size_t c = 0; c < width; c += tileWidth) {
+        const size_t len = std::min(tileWidth, width - c);
+        // whole registers of every instruction set read exactly the samples they need, the rest is done one by one
+        const size_t vectorLen = len / avx2Lanes * avx2Lanes;
+        auto filterRow = [&](size_t i) {
+            const int16_t* input = &x[i * xStride + c];
+            int16_t* output = &window[(i % kernelHeight) * tileWidth];
+            if (vectorLen > 0) {
+                convolve(input, horizontal, kernelWidth, output, vectorLen);
+            }
+            naive(&input[vectorLen], horizontal, kernelWidth, &output[vectorLen], len - vectorLen);
+        };
+        for (size_t i = 0; i + 1 < kernelHeight; ++i) {
+            filterRow(i);
+        }
+        for (size_t r = 0; r < height; ++r) {
+            filterRow(r + kernelHeight - 1);
+            // vertical[i] is multiplied with row r + kernelHeight - 1 - i
+            for (size_t i = 0; i < kernelHeight; ++i) {
+                rows[i] = &window[((r + kernelHeight - 1 - i) % kernelHeight) * tileWidth];
+            }
+            if (avx2) {
+                verticalRowAvx2(rows.data(), vertical, kernelHeight, &y[r * yStride + c], len);
+            } else {
+                verticalRow(rows.data(), vertical, kernelHeight, &y[r * yStride + c], 0, len);
+            }
+        }
+    }
+    return y;
+}
+
+int16_t* convolveDirect(const int16_t* x, size_t xStride, const int16_t* kernel, size_t kernelHeight, size_t kernelWidth,
+    int16_t* y, size_t yStride, size_t width, size_t height) {
+    const bool avx2 = cpu::supports(cpu::Isa::avx2);
+    std::vector<const int16_t*> rows(kernelHeight);
+    for (size_t r = 0; r < height; ++r) {
+        for (size_t i = 0; i < kernelHeight; ++i) {
+            rows[i] = &x[(r + kernelHeight - 1 - i) * xStride];
+        }
+        if (avx2) {
+            directRowAvx2(rows.data(), kernel, kernelHeight, kernelWidth, &y[r * yStride], width);
+        } else {
+            directRow(rows.data(), kernel, kernelHeight, kernelWidth, &y[r * yStride], 0, width);
+        }
+    }
+    return y;
+}
+
+int16_t* convolvePlane(const int16_t* x, size_t xStride, const int16_t* kernel, size_t kernelHeight, size_t kernelWidth,
+    int16_t* y, size_t yStride, size_t width, size_t height) {
+    std::vector<int16_t> vertical(kernelHeight);
+    std::vector<int16_t> horizontal(kernelWidth);
+    if (kernelHeight * kernelWidth > maxDirectTaps and separate(kernel, kernelHeight, kernelWidth, vertical.data(), horizontal.data())) {
+        return convolveSeparable(x, xStride, vertical.data(), kernelHeight, horizontal.data(), kernelWidth, y, yStride, width, height);
+    }
+    return convolveDirect(x, xStride, kernel, kernelHeight, kernelWidth, y, yStride, width, height);
+}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "convolution.hpp"
+#include "cpu.hpp"
+
+// 2D convolution of int16 image planes, the 1D convolution in both directions:
+// y[r][c] = k[0][0] * x[r + kernelHeight - 1][c + kernelWidth - 1] + ... + k[kernelHeight - 1][kernelWidth - 1] * x[r][c]
+//
+// Like the 1D input, x includes the borders: it has height + kernelHeight - 1 rows of width + kernelWidth - 1 samples,
+// row r starting at x[r * xStride], and nothing outside of that is read. Rows of y start at y[r * yStride], and exactly
+// width samples of each are written.
+namespace conv {
+
+// Splits a kernel of kernelHeight rows of kernelWidth weights into kernel[i][j] == vertical[i] * horizontal[j], if it
+// is separable in integers
+bool separate(const int16_t* kernel, size_t kernelHeight, size_t kernelWidth, int16_t* vertical, int16_t* horizontal);
+
+// Separable kernels: the plane is processed in strips of columns from top to bottom. Each input row of a strip is
+// filtered horizontally with convolve() into a rolling window of the last kernelHeight rows, and each output row is
+// then the vertical convolution of the window. The intermediate rows never leave the cache.
+int16_t* convolveSeparable(const int16_t* x, size_t xStride, const int16_t* vertical, size_t kernelHeight,
+    const int16_t* horizontal, size_t kernelWidth, int16_t* y, size_t yStride, size_t width, size_t height);
+
+// Any kernel: every weight is broadcast once and multiplied with the row it belongs to
+int16_t* convolveDirect(const int16_t* x, size_t xStride, const int16_t* kernel, size_t kernelHeight, size_t kernelWidth,
+    int16_t* y, size_t yStride, size_t width, size_t height);
+
+// convolveSeparable() if the kernel is separable and large enough for that to pay off, convolveDirect() otherwise
+int16_t* convolvePlane(const int16_t* x, size_t xStride, const int16_t* kernel, size_t kernelHeight, size_t kernelWidth,
+    int16_t* y, size_t yStride, size_t width, size_t height);
+}
@@ -0,0 +1,429 @@
+#include "resample.hpp"
+#include <algorithm>
+#include <immintrin.h>
+#include <vector>
+
+namespace conv {
+
+namespace {
+// outputs (decimation) or input samples (interpolation) per chunk, so that the phases stay in L1/L2
+constexpr size_t chunkLen = 1024;
+constexpr size_t blockRegisters = 4;
+// Phases of fewer weights than this cost more to split or merge than the multiplies they save, so such filters are
+// convolved in full instead; merging with gathers costs more than with shuffles. Measured with simd-bench --kernels
+// decimate,decimate-full,interpolate,interpolate-full.
+constexpr size_t minPhaseTaps = 3;
+constexpr size_t minGatheredPhaseTaps = 4;
+
+// Scratch buffers that live as long as the thread, so that short calls do not pay for allocating them. They hold
+// whatever the last call left in them.
+int16_t* scratch(size_t buffer, size_t len) {
+    thread_local std::vector<int16_t> buffers[3];
+    buffers[buffer].resize(std::max(buffers[buffer].size(), len));
+    return buffers[buffer].data();
+}
+
+// number of weights in phase p of a filter split into factor phases
+size_t phaseTaps(size_t hLen, size_t factor, size_t p) {
+    return p < hLen ? (hLen - 1 - p) / factor + 1 : 0;
+}
+
+int16_t* decimateNaive(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) {
+        y[k] = 0;
+        for (size_t i = 0; i < hLen; ++i) {
+            y[k] += h[i] * x[(hLen - 1) - i + k * factor];
+        }
+    }
+    return y;
+}
+
+int16_t* interpolateNaive(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t begin, size_t end) {
+    const size_t taps = phaseLen(hLen, factor);
+    for (size_t t = begin; t < end; ++t) {
+        const size_t m = t / factor;
+        const size_t p = t % factor;
+        y[t] = 0;
+        for (size_t q = 0; q < phaseTaps(hLen, factor, p); ++q) {
+            y[t] += h[p + q * factor] * x[(taps - 1) - q + m];
+        }
+    }
+    return y;
+}
+
+// phases[p * stride + n] = x[n * factor + p] for the first len samples of x; one phase at a time, so that the writes
+// are sequential and the inner loops have no bounds checks
+void splitPhases(const int16_t* x, size_t len, size_t factor, int16_t* phases, size_t stride) {
+    for (size_t p = 0; p < factor and p < len; ++p) {
+        const size_t count = (len - 1 - p) / factor + 1;
+        for (size_t n = 0; n < count; ++n) {
+            phases[p * stride + n] = x[n * factor + p];
+        }
+    }
+}
+
+// y[n * factor + p] = phases[p * stride + n] for n < len
+void mergePhases(const int16_t* phases, size_t stride, size_t len, size_t factor, int16_t* y) {
+    for (size_t p = 0; p < factor; ++p) {
+        for (size_t n = 0; n < len; ++n) {
+            y[n * factor + p] = phases[p * stride + n];
+        }
+    }
+}
+
+// The same with AVX2: factor 2 with shuffles (32 samples to 16 even and 16 odd ones), other factors with gathers of
+// 32 bit elements, which bring in two neighbouring phases at a time.
+TARGET_AVX2 void splitPhasesAvx2(const int16_t* x, size_t len, size_t factor, int16_t* phases, size_t stride) {
+    if (factor == 2) {
+        // even elements to the low and odd ones to the high half of each 128 bit lane
+        const __m256i evenOdd = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+            0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+        size_t i = 0;
+        for (; i + 2 * avx2Lanes <= len; i += 2 * avx2Lanes) {
+            // 64 bit quarters (even, even, odd, odd) of each input register
+            __m256i first = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&x[i]), evenOdd), 0xd8);
+            __m256i second = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&x[i + avx2Lanes]), evenOdd), 0xd8);
+            _mm256_storeu_si256((__m256i*)&phases[i / 2], _mm256_permute2x128_si256(first, second, 0x20));
+            _mm256_storeu_si256((__m256i*)&phases[stride + i / 2], _mm256_permute2x128_si256(first, second, 0x31));
+        }
+        splitPhases(&x[i], len - i, factor, &phases[i / 2], stride);
+        return;
+    }
+    // offsets of 8 consecutive samples of a phase, in 16 bit elements
+    const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(factor));
+    const __m256i lowHalves = _mm256_set1_epi32(0xffff);
+    // a gather for phase p also reads phase p + 1, which for the last one of an odd factor is phase 0 of the next
+    // sample, so the vectorized samples have to end before x[len - 1]
+    const size_t vectorLen = len > 0 ? (len - 1) / factor / avx2Lanes * avx2Lanes : 0;
+    for (size_t p = 0; p < factor; p += 2) {
+        for (size_t n = 0; n < vectorLen; n += avx2Lanes) {
+            __m256i first = _mm256_i32gather_epi32((const int*)&x[n * factor + p], index, 2);
+            __m256i second = _mm256_i32gather_epi32((const int*)&x[(n + avx2Lanes / 2) * factor + p], index, 2);
+            // the packs interleave the 128 bit lanes of both
+            __m256i low = _mm256_packus_epi32(_mm256_and_si256(first, lowHalves), _mm256_and_si256(second, lowHalves));
+            _mm256_storeu_si256((__m256i*)&phases[p * stride + n], _mm256_permute4x64_epi64(low, 0xd8));
+            if (p + 1 < factor) {
+                __m256i high = _mm256_packus_epi32(_mm256_srli_epi32(first, 16), _mm256_srli_epi32(second, 16));
+                _mm256_storeu_si256((__m256i*)&phases[(p + 1) * stride + n], _mm256_permute4x64_epi64(high, 0xd8));
+            }
+        }
+    }
+    for (size_t p = 0; p < factor and vectorLen * factor + p < len; ++p) {
+        for (size_t n = vectorLen; n * factor + p < len; ++n) {
+            phases[p * stride + n] = x[n * factor + p];
+        }
+    }
+}
+
+// [a0, b0, a1, b1, ...] in two registers
+TARGET_AVX2 void mergeTwo(__m256i a, __m256i b, __m256i* y) {
+    // outputs 0..3 and 8..11 in low, 4..7 and 12..15 in high
+    __m256i low = _mm256_unpacklo_epi16(a, b);
+    __m256i high = _mm256_unpackhi_epi16(a, b);
+    y[0] = _mm256_permute2x128_si256(low, high, 0x20);
+    y[1] = _mm256_permute2x128_si256(low, high, 0x31);
+}
+
+// Factor registers of phases to Factor registers of outputs for a power of two: the even outputs are the merged even
+// phases and the odd outputs the merged odd phases, with half the factor
+template<size_t Factor>
+TARGET_AVX2 void mergeRegisters(const __m256i* phases, __m256i* y) {
+    if constexpr (Factor == 1) {
+        y[0] = phases[0];
+    } else {
+        constexpr size_t half = Factor / 2;
+        __m256i split[2][half];
+        for (size_t i = 0; i < half; ++i) {
+            split[0][i] = phases[2 * i];
+            split[1][i] = phases[2 * i + 1];
+        }
+        __m256i even[half];
+        __m256i odd[half];
+        mergeRegisters<half>(split[0], even);
+        mergeRegisters<half>(split[1], odd);
+        for (size_t i = 0; i < half; ++i) {
+            mergeTwo(even[i], odd[i], &y[2 * i]);
+        }
+    }
+}
+
+template<size_t Factor>
+TARGET_AVX2 void mergePhasesAvx2(const int16_t* phases, size_t stride, size_t len, int16_t* y) {
+    size_t n = 0;
+    for (; n + avx2Lanes <= len; n += avx2Lanes) {
+        __m256i input[Factor];
+        for (size_t p = 0; p < Factor; ++p) {
+            input[p] = _mm256_loadu_si256((const __m256i*)&phases[p * stride + n]);
+        }
+        __m256i output[Factor];
+        mergeRegisters<Factor>(input, output);
+        for (size_t r = 0; r < Factor; ++r) {
+            _mm256_storeu_si256((__m256i*)&y[n * Factor + r * avx2Lanes], output[r]);
+        }
+    }
+    mergePhases(&phases[n], stride, len - n, Factor, &y[n * Factor]);
+}
+
+// Other factors with gathers of 32 bit elements: output j of a block of avx2Lanes * factor outputs is
+// phases[(j % factor) * stride + j / factor], and the next block reads avx2Lanes samples further. Each gather also reads
+// the sample after, so phases needs one element of room after the last phase.
+TARGET_AVX2 void mergeGatherAvx2(const int16_t* phases, size_t stride, size_t len, size_t factor, int16_t* y) {
+    thread_local std::vector<int32_t> offsets;
+    offsets.resize(avx2Lanes * factor);
+    for (size_t j = 0; j < offsets.size(); ++j) {
+        offsets[j] = (j % factor) * stride + j / factor;
+    }
+    const __m256i lowHalves = _mm256_set1_epi32(0xffff);
+    size_t n = 0;
+    for (; n + avx2Lanes <= len; n += avx2Lanes) {
+        const __m256i start = _mm256_set1_epi32(n);
+        for (size_t r = 0; r < factor; ++r) {
+            __m256i first = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)&offsets[r * avx2Lanes]), start);
+            __m256i second = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)&offsets[r * avx2Lanes + avx2Lanes / 2]), start);
+            first = _mm256_and_si256(_mm256_i32gather_epi32((const int*)phases, first, 2), lowHalves);
+            second = _mm256_and_si256(_mm256_i32gather_epi32((const int*)phases, second, 2), lowHalves);
+            // the pack interleaves the 128 bit lanes of both
+            __m256i output = _mm256_permute4x64_epi64(_mm256_packus_epi32(first, second), 0xd8);
+            _mm256_storeu_si256((__m256i*)&y[n * factor + r * avx2Lanes], output);
+        }
+    }
+    mergePhases(&phases[n], stride, len - n, factor, &y[n * factor]);
+}
+
+// the same with AVX2 shuffles for the power of two factors, which are the common ones, and gathers for the rest
+TARGET_AVX2 void mergePhasesAvx2(const int16_t* phases, size_t stride, size_t len, size_t factor, int16_t* y) {
+    switch (factor) {
+        case 2: return mergePhasesAvx2<2>(phases, stride, len, y);
+        case 4: return mergePhasesAvx2<4>(phases, stride, len, y);
+        case 8: return mergePhasesAvx2<8>(phases, stride, len, y);
+        default: return mergeGatherAvx2(phases, stride, len, factor, y);
+    }
+}
+
+// sum[r] += h[0] * x[taps - 1 + r * avx2Lanes] + h[stride] * x[taps - 2 + r * avx2Lanes] + ...: one phase of the
+// filter, each weight broadcast once and accumulated into Registers registers like in blockedAvx2
+template<size_t Registers>
+TARGET_AVX2 void accumulatePhaseAvx2(const int16_t* x, const int16_t* h, size_t taps, size_t stride, __m256i* sum) {
+    for (size_t i = 0; i < taps; ++i) {
+        const __m256i weight = _mm256_set1_epi16(h[i * stride]);
+        for (size_t r = 0; r < Registers; ++r) {
+            __m256i input = _mm256_loadu_si256((const __m256i*)&x[(taps - 1) - i + r * avx2Lanes]);
+            sum[r] = _mm256_add_epi16(sum[r], _mm256_mullo_epi16(input, weight));
+        }
+    }
+}
+
+// Registers registers of decimated outputs; phases are the inputs from the first output on, split by splitPhases()
+template<size_t Registers>
+TARGET_AVX2 void decimateRoundAvx2(const int16_t* phases, size_t stride, const int16_t* h, size_t hLen, size_t factor, int16_t* y) {
+    __m256i sum[Registers];
+    for (size_t r = 0; r < Registers; ++r) {
+        sum[r] = _mm256_setzero_si256();
+    }
+    // phase p gets the weights h[hLen - 1 - p], h[hLen - 1 - p - factor], ... in reverse
+    for (size_t p = 0; p < factor and p < hLen; ++p) {
+        const size_t taps = phaseTaps(hLen, factor, p);
+        accumulatePhaseAvx2<Registers>(&phases[p * stride], &h[(hLen - 1 - p) - (taps - 1) * factor], taps, factor, sum);
+    }
+    for (size_t r = 0; r < Registers; ++r) {
+        _mm256_storeu_si256((__m256i*)&y[r * avx2Lanes], sum[r]);
+    }
+}
+
+TARGET_AVX2 int16_t* decimateAvx2(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t yLen) {
+    // samples that may be read
+    const size_t xLen = (yLen - 1) * factor + hLen;
+    // each phase needs the samples of chunkLen outputs, rounded up to whole registers for the last round, plus the
+    // length of its sub-filter
+    const size_t stride = (std::min(chunkLen, yLen) + avx2Lanes - 1) / avx2Lanes * avx2Lanes + phaseLen(hLen, factor);
+    int16_t* phases = scratch(0, factor * stride);
+    for (size_t k = 0; k < yLen; k += chunkLen) {
+        const size_t len = std::min(chunkLen, yLen - k);
+        const size_t vectorLen = len / avx2Lanes * avx2Lanes;
+        splitPhasesAvx2(&x[k * factor], std::min(xLen - k * factor, stride * factor), factor, phases, stride);
+        size_t n = 0;
+        for (; n + blockRegisters * avx2Lanes <= vectorLen; n += blockRegisters * avx2Lanes) {
+            decimateRoundAvx2<blockRegisters>(&phases[n], stride, h, hLen, factor, &y[k + n]);
+        }
+        for (; n < vectorLen; n += avx2Lanes) {
+            decimateRoundAvx2<1>(&phases[n], stride, h, hLen, factor, &y[k + n]);
+        }
+        if (n < len) {
+            int16_t last[avx2Lanes];
+            decimateRoundAvx2<1>(&phases[n], stride, h, hLen, factor, last);
+            std::copy(last, last + (len - n), &y[k + n]);
+        }
+    }
+    return y;
+}
+
+// the same with AVX-512
+template<size_t Registers>
+TARGET_AVX512BW void accumulatePhaseAvx512(const int16_t* x, const int16_t* h, size_t taps, size_t stride, __m512i* sum) {
+    for (size_t i = 0; i < taps; ++i) {
+        const __m512i weight = _mm512_set1_epi16(h[i * stride]);
+        for (size_t r = 0; r < Registers; ++r) {
+            __m512i input = _mm512_loadu_si512(&x[(taps - 1) - i + r * avx512Lanes]);
+            sum[r] = _mm512_add_epi16(sum[r], _mm512_mullo_epi16(input, weight));
+        }
+    }
+}
+
+template<size_t Registers>
+TARGET_AVX512BW void decimateRoundAvx512(const int16_t* phases, size_t stride, const int16_t* h, size_t hLen, size_t factor, int16_t* y) {
+    __m512i sum[Registers];
+    for (size_t r = 0; r < Registers; ++r) {
+        sum[r] = _mm512_setzero_si512();
+    }
+    for (size_t p = 0; p < factor and p < hLen; ++p) {
+        const size_t taps = phaseTaps(hLen, factor, p);
+        accumulatePhaseAvx512<Registers>(&phases[p * stride], &h[(hLen - 1 - p) - (taps - 1) * factor], taps, factor, sum);
+    }
+    for (size_t r = 0; r < Registers; ++r) {
+        _mm512_storeu_si512(&y[r * avx512Lanes], sum[r]);
+    }
+}
+
+TARGET_AVX512BW int16_t* decimateAvx512(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t yLen) {
+    const size_t xLen = (yLen - 1) * factor + hLen;
+    const size_t stride = (std::min(chunkLen, yLen) + avx512Lanes - 1) / avx512Lanes * avx512Lanes + phaseLen(hLen, factor);
+    int16_t* phases = scratch(0, factor * stride);
+    for (size_t k = 0; k < yLen; k += chunkLen) {
+        const size_t len = std::min(chunkLen, yLen - k);
+        const size_t vectorLen = len / avx512Lanes * avx512Lanes;
+        splitPhasesAvx2(&x[k * factor], std::min(xLen - k * factor, stride * factor), factor, phases, stride);
+        size_t n = 0;
+        for (; n + blockRegisters * avx512Lanes <= vectorLen; n += blockRegisters * avx512Lanes) {
+            decimateRoundAvx512<blockRegisters>(&phases[n], stride, h, hLen, factor, &y[k + n]);
+        }
+        for (; n < vectorLen; n += avx512Lanes) {
+            decimateRoundAvx512<1>(&phases[n], stride, h, hLen, factor, &y[k + n]);
+        }
+        if (n < len) {
+            int16_t last[avx512Lanes];
+            decimateRoundAvx512<1>(&phases[n], stride, h, hLen, factor, last);
+            std::copy(last, last + (len - n), &y[k + n]);
+        }
+    }
+    return y;
+}
+
+// The full convolutions for short phases, in chunks: every factor-th output of convolve(), straight from x as long as
+// the padding convolve() reads stays within it and through a padded copy at the end
+int16_t* decimateFull(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t yLen) {
+    const Padding padding = convolvePadding(hLen);
+    const size_t xLen = (yLen - 1) * factor + hLen;
+    const size_t maxFullLen = (std::min(chunkLen, yLen) - 1) * factor + 1;
+    int16_t* input = scratch(0, maxFullLen + padding.inputAfter);
+    int16_t* full = scratch(1, maxFullLen + padding.outputAfter);
+    for (size_t k = 0; k < yLen; k += chunkLen) {
+        const size_t len = std::min(chunkLen, yLen - k);
+        const size_t fullLen = (len - 1) * factor + 1;
+        const int16_t* chunk = &x[k * factor];
+        if (k * factor + fullLen + padding.inputAfter > xLen) {
+            std::copy(chunk, chunk + fullLen + hLen - 1, input);
+            chunk = input;
+        }
+        convolve(chunk, h, hLen, full, fullLen);
+        for (size_t n = 0; n < len; ++n) {
+            y[k + n] = full[n * factor];
+        }
+    }
+    return y;
+}
+
+// and convolve() of the input stuffed with zeros
+int16_t* interpolateFull(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t yLen) {
+    const Padding padding = convolvePadding(hLen);
+    const size_t taps = phaseLen(hLen, factor);
+    // inputs with at least one output
+    const size_t inputLen = (yLen + factor - 1) / factor;
+    const size_t maxChunkLen = std::min(chunkLen, inputLen);
+    // every chunk puts its samples at the same places, so the zeros in between stay
+    const size_t stuffedLen = (hLen - 1) + maxChunkLen * factor + padding.inputAfter;
+    int16_t* stuffed = scratch(0, stuffedLen);
+    std::fill(stuffed, stuffed + stuffedLen, 0);
+    int16_t* output = scratch(1, maxChunkLen * factor + padding.outputAfter);
+    for (size_t m = 0; m < inputLen; m += chunkLen) {
+        const size_t len = std::min(chunkLen, inputLen - m);
+        const size_t outputLen = std::min(len * factor, yLen - m * factor);
+        // x[m + n] is the upsampled sample of output (n - (taps - 1)) * factor, and the outputs start after hLen - 1
+        for (size_t n = 0; n < len + taps - 1; ++n) {
+            stuffed[(hLen - 1) + n * factor - (taps - 1) * factor] = x[m + n];
+        }
+        // straight into y while the padding convolve() writes is still within it
+        if (m * factor + outputLen + padding.outputAfter <= yLen) {
+            convolve(stuffed, h, hLen, &y[m * factor], outputLen);
+        }
+        else {
+            convolve(stuffed, h, hLen, output, outputLen);
+            std::copy(output, output + outputLen, &y[m * factor]);
+        }
+    }
+    return y;
+}
+}
+
+int16_t* decimate(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t yLen) {
+    if (yLen == 0) {
+        return y;
+    }
+    if (cpu::supports(cpu::Isa::avx2) and phaseLen(hLen, factor) < minPhaseTaps) {
+        return decimateFull(x, h, hLen, factor, y, yLen);
+    }
+    if (cpu::supports(cpu::Isa::avx512bw)) {
+        return decimateAvx512(x, h, hLen, factor, y, yLen);
+    }
+    if (cpu::supports(cpu::Isa::avx2)) {
+        return decimateAvx2(x, h, hLen, factor, y, yLen);
+    }
+    return decimateNaive(x, h, hLen, factor, y, 0, yLen);
+}
+
+int16_t* interpolate(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t yLen) {
+    const bool avx2 = cpu::supports(cpu::Isa::avx2);
+    const size_t maxTaps = phaseLen(hLen, factor);
+    const bool gathered = factor != 2 and factor != 4 and factor != 8;
+    if (avx2 and maxTaps < (gathered ? minGatheredPhaseTaps : minPhaseTaps)) {
+        return interpolateFull(x, h, hLen, factor, y, yLen);
+    }
+    const Padding padding = convolvePadding(maxTaps);
+    // phase p gets the weights h[p], h[p + factor], ...
+    int16_t* filters = scratch(0, factor * maxTaps);
+    for (size_t p = 0; p < factor; ++p) {
+        for (size_t q = 0; q < phaseTaps(hLen, factor, p); ++q) {
+            filters[p * maxTaps + q] = h[p + q * factor];
+        }
+    }
+    // inputs for which all factor outputs are needed
+    const size_t inputLen = yLen / factor;
+    // the input of a chunk with the padding convolve() reads, and the phases of its outputs with one more element for
+    // the gathers of mergeGatherAvx2()
+    const size_t maxChunkLen = std::min(chunkLen, inputLen);
+    int16_t* input = scratch(1, maxChunkLen + (maxTaps - 1) + padding.outputAfter);
+    const size_t stride = maxChunkLen + padding.outputAfter;
+    int16_t* phases = scratch(2, factor * stride + 1);
+    for (size_t m = 0; m < inputLen; m += chunkLen) {
+        const size_t len = std::min(chunkLen, inputLen - m);
+        std::copy(&x[m], &x[m + len + maxTaps - 1], input);
+        for (size_t p = 0; p < factor; ++p) {
+            const size_t taps = phaseTaps(hLen, factor, p);
+            // the shorter phases skip the first samples, which the longest one multiplies by its last weight
+            if (taps > 0) {
+                convolve(&input[maxTaps - taps], &filters[p * maxTaps], taps, &phases[p * stride], len);
+            }
+            else {
+                std::fill(&phases[p * stride], &phases[p * stride + len], 0);
+            }
+        }
+        if (avx2) {
+            mergePhasesAvx2(phases, stride, len, factor, &y[m * factor]);
+        }
+        else {
+            mergePhases(phases, stride, len, factor, &y[m * factor]);
+        }
+    }
+    interpolateNaive(x, h, hLen, factor, y, inputLen * factor, yLen);
+    return y;
+}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "convolution.hpp"
+#include "cpu.hpp"
+
+// Polyphase resampling: convolution fused with downsampling or with zero-stuffing upsampling. Only the outputs that are
+// kept get calculated and the stuffed zeros are never multiplied, so the work scales with the output rate. The filter
+// is split into factor sub-filters (phases) of every factor-th weight, and each phase is a plain convolution with
+// contiguous loads; the strided access is moved into splitting the input into phases (decimation) or merging the
+// phases of the output (interpolation). Filters with phases too short to pay for that are convolved in full instead.
+namespace conv {
+
+// Every factor-th output of convolve(): y[k] = h[0] * x[hLen - 1 + k * factor] + ... + h[hLen - 1] * x[k * factor].
+// x starts with the usual hLen - 1 zeros and is read up to x[(yLen - 1) * factor + hLen - 1]; no other padding needed.
+int16_t* decimate(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t yLen);
+
+// length of the longest phase of a filter split for interpolate()
+constexpr size_t phaseLen(size_t hLen, size_t factor) {
+    return (hLen + factor - 1) / factor;
+}
+
+// convolve() of x upsampled by factor, i.e. with factor - 1 zeros after each sample. With taps = phaseLen(hLen, factor):
+// y[m * factor + p] = h[p] * x[taps - 1 + m] + h[p + factor] * x[taps - 2 + m] + ...
+// x starts with taps - 1 zeros and is read up to x[taps - 1 + (yLen - 1) / factor]; no other padding needed.
+int16_t* interpolate(const int16_t* x, const int16_t* h, size_t hLen, size_t factor, int16_t* y, size_t yLen);
+}
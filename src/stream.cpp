@@ -0,0 +1,154 @@
+#include "stream.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace conv {
+
+StreamConvolver::StreamConvolver(const int16_t* h, size_t hLen)
+    : h(h, h + hLen), hLen(hLen), lanes(convolvePadding(hLen).outputAfter + 1), history(hLen - 1) {
+    // the buffered parts are at most hLen - 1 outputs in the beginning of a chunk and less than lanes in the end
+    const Padding padding = convolvePadding(hLen);
+    const size_t bufferedLen = std::max(hLen - 1, lanes);
+    input.resize(padding.inputBefore + bufferedLen + padding.inputAfter);
+    output.resize(bufferedLen + padding.outputAfter);
+}
+
+void StreamConvolver::push(const int16_t* x, size_t xLen, int16_t* y) {
+    const size_t overlap = hLen - 1;
+
+    // first outputs depend on the previous chunks
+    const size_t headLen = std::min(overlap, xLen);
+    std::copy(history.begin(), history.end(), input.begin());
+    std::copy(x, x + headLen, input.begin() + overlap);
+    convolveBuffered(headLen, y);
+
+    if (xLen <= overlap) {
+        std::copy(history.begin() + xLen, history.end(), history.begin());
+        std::copy(x, x + xLen, history.end() - xLen);
+        return;
+    }
+
+    // whole rounds of the kernel read at most up to x[xLen - 1], so they can be calculated in place
+    const size_t directLen = (xLen - overlap) / lanes * lanes;
+    convolve(x, h.data(), hLen, y + overlap, directLen);
+
+    const size_t tailLen = (xLen - overlap) - directLen;
+    std::copy(x + directLen, x + xLen, input.begin());
+    convolveBuffered(tailLen, y + overlap + directLen);
+
+    std::copy(x + xLen - overlap, x + xLen, history.begin());
+}
+
+void StreamConvolver::flush(int16_t* y) {
+    const size_t overlap = hLen - 1;
+    std::copy(history.begin(), history.end(), input.begin());
+    std::fill(input.begin() + overlap, input.begin() + 2 * overlap, 0);
+    convolveBuffered(overlap, y);
+    std::fill(history.begin(), history.end(), 0);
+}
+
+// input has to be filled with the hLen - 1 + yLen samples needed for the outputs
+void StreamConvolver::convolveBuffered(size_t yLen, int16_t* y) {
+    convolve(input.data(), h.data(), hLen, output.data(), yLen);
+    std::copy(output.begin(), output.begin() + yLen, y);
+}
+
+namespace {
+constexpr size_t chunkLen = 1 << 16;
+
+bool writeAll(int fd, const int16_t* y, size_t yLen) {
+    const char* data = reinterpret_cast<const char*>(y);
+    size_t left = yLen * sizeof(int16_t);
+    while (left > 0) {
+        const ssize_t written = write(fd, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        left -= written;
+    }
+    return true;
+}
+
+bool convolveMapped(const int16_t* x, size_t xLen, int outFd, StreamConvolver& convolver, std::vector<int16_t>& y) {
+    const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t released = reinterpret_cast<uintptr_t>(x);
+    for (size_t t = 0; t < xLen; t += chunkLen) {
+        const size_t len = std::min(chunkLen, xLen - t);
+        convolver.push(&x[t], len, y.data());
+        if (not writeAll(outFd, y.data(), len)) {
+            return false;
+        }
+        // the convolver keeps its own copy of the overlap, so the pages behind can be dropped to keep the memory
+        // use constant
+        const uintptr_t consumed = reinterpret_cast<uintptr_t>(&x[t + len]) / pageSize * pageSize;
+        if (consumed > released) {
+            madvise(reinterpret_cast<void*>(released), consumed - released, MADV_DONTNEED);
+            released = consumed;
+        }
+    }
+    return true;
+}
+
+bool convolveRead(int inFd, int outFd, StreamConvolver& convolver, std::vector<int16_t>& y) {
+    std::vector<int16_t> x(chunkLen);
+    char* buffer = reinterpret_cast<char*>(x.data());
+    size_t bufferedBytes = 0;
+    while (true) {
+        const ssize_t received = read(inFd, buffer + bufferedBytes, chunkLen * sizeof(int16_t) - bufferedBytes);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (received == 0) {
+            return true; // a trailing odd byte is not a sample
+        }
+        bufferedBytes += received;
+        const size_t len = bufferedBytes / sizeof(int16_t);
+        convolver.push(x.data(), len, y.data());
+        if (not writeAll(outFd, y.data(), len)) {
+            return false;
+        }
+        // keep a half-read sample for the next round
+        buffer[0] = buffer[len * sizeof(int16_t)];
+        bufferedBytes -= len * sizeof(int16_t);
+    }
+}
+}
+
+bool convolveStream(int inFd, int outFd, const int16_t* h, size_t hLen) {
+    StreamConvolver convolver(h, hLen);
+    std::vector<int16_t> y(std::max(chunkLen, convolver.flushLen()));
+
+    bool ok = false;
+    struct stat status;
+    void* mapped = MAP_FAILED;
+    size_t mappedBytes = 0;
+    if (fstat(inFd, &status) == 0 and S_ISREG(status.st_mode) and status.st_size > 0) {
+        mappedBytes = status.st_size;
+        mapped = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, inFd, 0);
+    }
+    if (mapped != MAP_FAILED) {
+        madvise(mapped, mappedBytes, MADV_SEQUENTIAL);
+        ok = convolveMapped(static_cast<const int16_t*>(mapped), mappedBytes / sizeof(int16_t), outFd, convolver, y);
+        munmap(mapped, mappedBytes);
+    }
+    else {
+        ok = convolveRead(inFd, outFd, convolver, y);
+    }
+
+    if (not ok) {
+        return false;
+    }
+    convolver.flush(y.data());
+    return writeAll(outFd, y.data(), convolver.flushLen());
+}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "convolution.hpp"
+
+namespace conv {
+
+// Overlap-save convolution of a signal that arrives in chunks of any size. Only the last hLen - 1 samples are kept
+// between the chunks, so the memory use does not depend on the length of the stream. Most of each chunk is convolved
+// in place with conv::convolve(); only the hLen - 1 outputs around the chunk boundaries go through a small internal
+// buffer, so the chunks do not need any padding.
+class StreamConvolver {
+public:
+    StreamConvolver(const int16_t* h, size_t hLen);
+
+    // calculates the next xLen outputs of the stream into y
+    void push(const int16_t* x, size_t xLen, int16_t* y);
+
+    // calculates the last flushLen() outputs (the part where the filter runs past the end of the stream) into y and
+    // starts a new stream
+    void flush(int16_t* y);
+    size_t flushLen() const { return hLen - 1; }
+
+private:
+    void convolveBuffered(size_t yLen, int16_t* y);
+
+    std::vector<int16_t> h;
+    size_t hLen;
+    size_t lanes;                 // the kernel writes whole multiples of this many outputs
+    std::vector<int16_t> history; // last hLen - 1 samples of the previous chunks
+    std::vector<int16_t> input;
+    std::vector<int16_t> output;
+};
+
+// Convolves raw native-endian int16 samples from inFd into outFd. Regular files are mmap'd and read in place,
+// anything else (pipes, stdin) is read in fixed-size chunks. Returns false on an I/O error, with errno set.
+bool convolveStream(int inFd, int outFd, const int16_t* h, size_t hLen);
+}